@@ -0,0 +1,308 @@
+#include "Cache.h"
+#include "Disque.h"
+#include <string.h>
+#include <stddef.h>
+
+// les tampons sont ranges dans une table de hachage sur le numero de secteur
+// et dans une liste LRU: tete = plus recemment utilise, queue = prochain a sortir
+
+typedef struct cache_buffer {
+    int sector;   // -1 si le tampon est libre
+    int refcount; // utilisateurs entre Cache_Get et Cache_Release
+    int dirty;
+    struct cache_buffer* hnext;
+    struct cache_buffer* prev;
+    struct cache_buffer* next;
+    char data[SECTOR_SIZE];
+} cache_buffer_t;
+
+static cache_buffer_t* _buffers = NULL;
+static int _nb_buffers = 0;
+static int _budget = CACHE_DEFAULT_BUDGET;
+static cache_buffer_t* _hash[CACHE_HASH_SIZE];
+static cache_buffer_t* _lru_head = NULL;
+static cache_buffer_t* _lru_tail = NULL;
+static cache_stats_t _stats;
+
+static void _lru_unlink(cache_buffer_t* b)
+{
+    if(b->prev) b->prev->next = b->next; else _lru_head = b->next;
+    if(b->next) b->next->prev = b->prev; else _lru_tail = b->prev;
+    b->prev = b->next = NULL;
+}
+
+static void _lru_push_head(cache_buffer_t* b)
+{
+    b->prev = NULL;
+    b->next = _lru_head;
+    if(_lru_head) _lru_head->prev = b; else _lru_tail = b;
+    _lru_head = b;
+}
+
+static void _hash_remove(cache_buffer_t* b)
+{
+    cache_buffer_t** p = &_hash[b->sector % CACHE_HASH_SIZE];
+    while(*p != b) {
+	p = &(*p)->hnext;
+    }
+    *p = b->hnext;
+    b->hnext = NULL;
+}
+
+/*
+ * Allocation des tampons selon le budget, tous libres
+ */
+static int _cache_alloc()
+{
+    int n = _budget / SECTOR_SIZE;
+    if(n < CACHE_MIN_BUFFERS) {
+	n = CACHE_MIN_BUFFERS;
+    }
+    cache_buffer_t* buffers = malloc(n * sizeof(cache_buffer_t));
+    if(buffers == NULL) {
+	return -1;
+    }
+    free(_buffers);
+    _buffers = buffers;
+    _nb_buffers = n;
+    memset(_hash, 0, sizeof(_hash));
+    _lru_head = _lru_tail = NULL;
+    for(int i = 0; i < n; i++) {
+	_buffers[i].sector = -1;
+	_buffers[i].refcount = 0;
+	_buffers[i].dirty = 0;
+	_buffers[i].hnext = NULL;
+	_lru_push_head(&_buffers[i]);
+    }
+    return 0;
+}
+
+static int _cache_writeback(cache_buffer_t* b)
+{
+    if(Disk_Write(b->sector, b->data) == -1) {
+	return -1;
+    }
+    b->dirty = 0;
+    _stats.writebacks++;
+    return 0;
+}
+
+/*
+ * Tampon a reutiliser: le moins recemment utilise qui n est pas en cours d utilisation
+ */
+static cache_buffer_t* _cache_victim()
+{
+    for(cache_buffer_t* b = _lru_tail; b != NULL; b = b->prev) {
+	if(b->refcount > 0) {
+	    continue;
+	}
+	if(b->sector != -1) {
+	    if(b->dirty && _cache_writeback(b) == -1) {
+		return NULL;
+	    }
+	    _hash_remove(b);
+	    _stats.evictions++;
+	    b->sector = -1;
+	}
+	return b;
+    }
+    // tous les tampons sont en cours d utilisation
+    diskErrno = E_MEM_OP;
+    return NULL;
+}
+
+/*
+ * Cache_Reset
+ *
+ * Le contenu du disque a change sous le cache: tout est oublie. Comme pour
+ * Cache_SetBudget, un tampon retenu (vue, fenetre) ferait relacher plus tard
+ * un tampon qui a change de secteur: le cache reste alors tel quel
+ */
+int Cache_Reset()
+{
+    if(_buffers == NULL) {
+	if(_cache_alloc() == -1) {
+	    diskErrno = E_MEM_OP;
+	    return -1;
+	}
+	return 0;
+    }
+    for(int i = 0; i < _nb_buffers; i++) {
+	if(_buffers[i].refcount > 0) {
+	    diskErrno = E_INVALID_PARAM;
+	    return -1;
+	}
+    }
+    memset(_hash, 0, sizeof(_hash));
+    for(int i = 0; i < _nb_buffers; i++) {
+	_buffers[i].sector = -1;
+	_buffers[i].dirty = 0;
+	_buffers[i].hnext = NULL;
+    }
+    return 0;
+}
+
+/*
+ * Cache_SetBudget
+ *
+ * Changement de la taille du cache; le contenu est ecrit puis oublie
+ */
+int Cache_SetBudget(int bytes)
+{
+    for(int i = 0; i < _nb_buffers; i++) {
+	if(_buffers[i].refcount > 0) {
+	    diskErrno = E_INVALID_PARAM;
+	    return -1;
+	}
+    }
+    if(Cache_Flush() == -1) {
+	return -1;
+    }
+    int old = _budget;
+    _budget = bytes;
+    if(_cache_alloc() == -1) {
+	_budget = old;
+	diskErrno = E_MEM_OP;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * Cache_Get
+ *
+ * Tampon du secteur, charge du disque si besoin et si load
+ */
+char* Cache_Get(int sector, int load)
+{
+    if(sector < 0 || sector >= NUM_SECTORS) {
+	diskErrno = E_INVALID_PARAM;
+	return NULL;
+    }
+    if(_buffers == NULL && _cache_alloc() == -1) {
+	diskErrno = E_MEM_OP;
+	return NULL;
+    }
+    cache_buffer_t* b = _hash[sector % CACHE_HASH_SIZE];
+    while(b != NULL && b->sector != sector) {
+	b = b->hnext;
+    }
+    if(b != NULL) {
+	_stats.hits++;
+    } else {
+	_stats.misses++;
+	b = _cache_victim();
+	if(b == NULL) {
+	    return NULL;
+	}
+	if(load && Disk_Read(sector, b->data) == -1) {
+	    return NULL;
+	}
+	b->sector = sector;
+	b->dirty = 0;
+	b->hnext = _hash[sector % CACHE_HASH_SIZE];
+	_hash[sector % CACHE_HASH_SIZE] = b;
+    }
+    b->refcount++;
+    _lru_unlink(b);
+    _lru_push_head(b);
+    return b->data;
+}
+
+/*
+ * Cache_Release
+ *
+ * Fin d utilisation d un tampon de Cache_Get
+ */
+void Cache_Release(char* data, int dirty)
+{
+    // data peut pointer n importe ou dans le tampon: on retrouve le tampon par sa place
+    cache_buffer_t* b = &_buffers[(data - (char*) _buffers) / (ptrdiff_t) sizeof(cache_buffer_t)];
+    if(dirty) {
+	b->dirty = 1;
+    }
+    b->refcount--;
+}
+
+void Cache_MarkDirty(char* data)
+{
+    _buffers[(data - (char*) _buffers) / (ptrdiff_t) sizeof(cache_buffer_t)].dirty = 1;
+}
+
+/*
+ * Cache_Prefetch
+ *
+ * Un secteur deja present n est pas remonte dans la liste LRU: la lecture
+ * anticipee ne doit pas proteger un secteur que personne n a encore demande
+ */
+int Cache_Prefetch(int sector)
+{
+    if(sector < 0 || sector >= NUM_SECTORS) {
+	diskErrno = E_INVALID_PARAM;
+	return -1;
+    }
+    cache_buffer_t* b = _hash[sector % CACHE_HASH_SIZE];
+    while(b != NULL && b->sector != sector) {
+	b = b->hnext;
+    }
+    if(b != NULL) {
+	return 0;
+    }
+    char* data = Cache_Get(sector, 1);
+    if(data == NULL) {
+	return -1;
+    }
+    // Cache_Get a compte un defaut: c est une lecture anticipee
+    _stats.misses--;
+    _stats.prefetches++;
+    Cache_Release(data, 0);
+    return 0;
+}
+
+int Cache_Read(int sector, char* buffer)
+{
+    char* data = Cache_Get(sector, 1);
+    if(data == NULL) {
+	return -1;
+    }
+    memcpy(buffer, data, SECTOR_SIZE);
+    Cache_Release(data, 0);
+    return 0;
+}
+
+int Cache_Write(int sector, const char* buffer)
+{
+    char* data = Cache_Get(sector, 0);
+    if(data == NULL) {
+	return -1;
+    }
+    memcpy(data, buffer, SECTOR_SIZE);
+    Cache_Release(data, 1);
+    return 0;
+}
+
+/*
+ * Cache_Flush
+ *
+ * Ecriture des secteurs modifies; ils restent dans le cache
+ */
+int Cache_Flush()
+{
+    int ret = 0;
+    for(int i = 0; i < _nb_buffers; i++) {
+	if(_buffers[i].sector != -1 && _buffers[i].dirty && _cache_writeback(&_buffers[i]) == -1) {
+	    ret = -1;
+	}
+    }
+    return ret;
+}
+
+void Cache_GetStats(cache_stats_t* stats)
+{
+    *stats = _stats;
+}
+
+void Cache_ResetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
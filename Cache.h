@@ -0,0 +1,55 @@
+//
+// Cache.h
+//
+// Cache des secteurs entre le FS et le disque: ecriture differee et
+// remplacement du moins recemment utilise (LRU)
+//
+
+#ifndef __Cache_H__
+#define __Cache_H__
+
+// parametres fixe
+#define CACHE_DEFAULT_BUDGET  (256 * 512) // octets de donnees, soit 256 secteurs
+#define CACHE_MIN_BUFFERS     8
+#define CACHE_HASH_SIZE       1024
+
+//compteurs du cache depuis le dernier Cache_ResetStats
+typedef struct cache_stats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;  // secteurs sortis du cache pour faire de la place
+    unsigned long writebacks; // secteurs modifies ecrits sur le disque
+    unsigned long prefetches; // secteurs charges par Cache_Prefetch
+} cache_stats_t;
+
+//oublie tout le contenu sans rien ecrire, a appeler quand une image disque est chargee.
+//Echoue si un secteur est en cours d utilisation
+int Cache_Reset();
+//taille du cache en octets (au moins CACHE_MIN_BUFFERS secteurs); les secteurs
+//modifies sont d abord ecrits. Echoue si un secteur est en cours d utilisation
+int Cache_SetBudget(int bytes);
+
+//copie d un secteur a travers le cache
+int Cache_Read(int sector, char* buffer);
+//le secteur est remplace en entier et ne sera ecrit sur le disque qu au Cache_Flush
+//ou quand il sortira du cache
+int Cache_Write(int sector, const char* buffer);
+
+//acces direct au tampon d un secteur, qui reste dans le cache jusqu au Cache_Release;
+//load a 0 evite la lecture du disque quand le secteur va etre reecrit en entier
+char* Cache_Get(int sector, int load);
+//fin d utilisation du tampon rendu par Cache_Get (data peut pointer n importe ou
+//dans le secteur); dirty indique qu il a ete modifie
+void Cache_Release(char* data, int dirty);
+//le secteur sera ecrit sur le disque, pour un tampon retenu modifie avant son Cache_Release
+void Cache_MarkDirty(char* data);
+//lecture anticipee: charge le secteur s il n est pas deja dans le cache, sans le copier
+int Cache_Prefetch(int sector);
+
+//ecriture sur le disque de tous les secteurs modifies
+int Cache_Flush();
+
+void Cache_GetStats(cache_stats_t* stats);
+void Cache_ResetStats();
+
+#endif // __Cache_H__
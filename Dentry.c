@@ -0,0 +1,132 @@
+#include "Dentry.h"
+#include <string.h>
+
+// les deux caches sont a correspondance directe: une collision remplace l ancienne entree
+
+typedef struct dentry {
+    int used;
+    int parent;
+    char name[DENTRY_NAME_SIZE];
+    int inode;
+} dentry_t;
+
+typedef struct dentry_path {
+    unsigned int generation; // valide seulement si egal a _path_generation
+    char path[DENTRY_PATH_SIZE];
+    int inode;
+} dentry_path_t;
+
+static dentry_t _dentry_cache[DENTRY_CACHE_SIZE];
+static dentry_path_t _path_cache[DENTRY_PATH_CACHE_SIZE];
+// incrementer la generation invalide tous les chemins d un coup, la generation 0 n est jamais valide
+static unsigned int _path_generation = 1;
+
+/*
+ * Hachage FNV-1a sur au plus max caracteres
+ */
+static unsigned int _dentry_hash(unsigned int hash, const char* str, int max)
+{
+    for(int i = 0; i < max && str[i] != '\0'; i++) {
+	hash ^= (unsigned char) str[i];
+	hash *= 16777619u;
+    }
+    return hash;
+}
+
+static dentry_t* _dentry_slot(int parent, const char* name)
+{
+    unsigned int hash = 2166136261u ^ (unsigned int) parent;
+    hash *= 16777619u;
+    hash = _dentry_hash(hash, name, DENTRY_NAME_SIZE);
+    return &_dentry_cache[hash % DENTRY_CACHE_SIZE];
+}
+
+/*
+ * Dentry_Reset
+ *
+ * Vide les caches, par exemple quand une nouvelle image disque est chargee
+ */
+void Dentry_Reset()
+{
+    memset(_dentry_cache, 0, sizeof(_dentry_cache));
+    memset(_path_cache, 0, sizeof(_path_cache));
+    _path_generation = 1;
+}
+
+/*
+ * Dentry_Lookup
+ *
+ * Recherche de l entree (parent, name)
+ */
+int Dentry_Lookup(int parent, const char* name, int* inodePtr)
+{
+    dentry_t* d = _dentry_slot(parent, name);
+    if(!d->used || d->parent != parent || strncmp(d->name, name, DENTRY_NAME_SIZE) != 0) {
+	return 0;
+    }
+    *inodePtr = d->inode;
+    return 1;
+}
+
+/*
+ * Dentry_Insert
+ *
+ * Ajout de l entree (parent, name), positive ou negative
+ */
+void Dentry_Insert(int parent, const char* name, int inode)
+{
+    dentry_t* d = _dentry_slot(parent, name);
+    d->used = 1;
+    d->parent = parent;
+    strncpy(d->name, name, DENTRY_NAME_SIZE);
+    d->inode = inode;
+}
+
+/*
+ * Dentry_LookupPath
+ *
+ * Recherche d un chemin complet deja resolu
+ */
+int Dentry_LookupPath(const char* path, int* inodePtr)
+{
+    if(strlen(path) >= DENTRY_PATH_SIZE) {
+	return 0;
+    }
+    dentry_path_t* p = &_path_cache[_dentry_hash(2166136261u, path, DENTRY_PATH_SIZE) % DENTRY_PATH_CACHE_SIZE];
+    if(p->generation != _path_generation || strcmp(p->path, path) != 0) {
+	return 0;
+    }
+    *inodePtr = p->inode;
+    return 1;
+}
+
+/*
+ * Dentry_InsertPath
+ *
+ * Ajout d un chemin complet resolu; les chemins trop longs ne sont pas gardes
+ */
+void Dentry_InsertPath(const char* path, int inode)
+{
+    if(strlen(path) >= DENTRY_PATH_SIZE) {
+	return;
+    }
+    dentry_path_t* p = &_path_cache[_dentry_hash(2166136261u, path, DENTRY_PATH_SIZE) % DENTRY_PATH_CACHE_SIZE];
+    p->generation = _path_generation;
+    strcpy(p->path, path);
+    p->inode = inode;
+}
+
+/*
+ * Dentry_InvalidatePaths
+ *
+ * Une suppression peut invalider n importe quel chemin qui passe par l entree supprimee
+ */
+void Dentry_InvalidatePaths()
+{
+    _path_generation++;
+    if(_path_generation == 0) {
+	// retour a zero apres debordement: on vide vraiment le cache
+	memset(_path_cache, 0, sizeof(_path_cache));
+	_path_generation = 1;
+    }
+}
@@ -0,0 +1,36 @@
+//
+// Dentry.h
+//
+// Cache memoire des entrees de repertoire pour la resolution des chemins
+//
+//
+
+#ifndef __Dentry_H__
+#define __Dentry_H__
+
+// parametres fixe
+#define DENTRY_CACHE_SIZE       1024 // entrees (inode parent, nom)
+#define DENTRY_PATH_CACHE_SIZE  256  // chemins complets deja resolus
+#define DENTRY_NAME_SIZE        16
+#define DENTRY_PATH_SIZE        256
+
+// une entree negative (le nom n existe pas) a pour inode DENTRY_NEGATIVE
+#define DENTRY_NEGATIVE -1
+
+//vide les deux caches, a appeler au boot
+void Dentry_Reset();
+
+//recherche de (parent, name); retourne 1 si l entree est connue (inode dans *inodePtr,
+//eventuellement DENTRY_NEGATIVE) et 0 sinon
+int Dentry_Lookup(int parent, const char* name, int* inodePtr);
+//ajout ou mise a jour de (parent, name) -> inode, inode peut etre DENTRY_NEGATIVE
+void Dentry_Insert(int parent, const char* name, int inode);
+
+//recherche d un chemin absolu complet; retourne 1 si trouve et 0 sinon
+int Dentry_LookupPath(const char* path, int* inodePtr);
+//ajout d un chemin resolu (entrees positives uniquement)
+void Dentry_InsertPath(const char* path, int inode);
+//invalide tous les chemins complets, a appeler a chaque suppression
+void Dentry_InvalidatePaths();
+
+#endif // __Dentry_H__
@@ -0,0 +1,106 @@
+#include "DirSearch.h"
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * DirSearch_MakeKey
+ *
+ * Les noms sont ranges completes par des 0: avec la cle completee de la meme
+ * facon, comparer un nom revient a comparer 16 octets. Un nom de 16 caracteres
+ * ou plus donne une cle sans 0 qui ne peut correspondre a aucune entree.
+ */
+void DirSearch_MakeKey(char* key, const char* name)
+{
+    memset(key, 0, DIRSEARCH_NAME_SIZE);
+    strncpy(key, name, DIRSEARCH_NAME_SIZE);
+}
+
+/*
+ * DirSearch_Block_Scalar
+ *
+ * Une comparaison de 16 octets par entree
+ */
+int DirSearch_Block_Scalar(const void* entries, int nbEntries, const char* key)
+{
+    const char* e = (const char*) entries;
+    // une cle vide correspondrait aux entrees libres
+    if(key[0] == '\0') {
+	return -1;
+    }
+    for(int i = 0; i < nbEntries; i++) {
+	if(memcmp(e + i*DIRSEARCH_ENTRY_SIZE, key, DIRSEARCH_NAME_SIZE) == 0) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+/*
+ * DirSearch_Block
+ *
+ * SSE2: une comparaison 16 octets par entree, le nom correspond si les 16 octets sont egaux.
+ * AVX2: deux noms sont charges dans un registre de 32 octets et compares en une fois.
+ * Les entrees sont traitees par 4 pour n avoir qu un test par groupe.
+ */
+int DirSearch_Block(const void* entries, int nbEntries, const char* key)
+{
+#if defined(__SSE2__)
+    const char* e = (const char*) entries;
+    if(key[0] == '\0') {
+	return -1;
+    }
+    __m128i k = _mm_loadu_si128((const __m128i*) key);
+    int i = 0;
+#if defined(__AVX2__)
+    __m256i k2 = _mm256_broadcastsi128_si256(k);
+    for(; i + 3 < nbEntries; i += 4) {
+	const char* p = e + i*DIRSEARCH_ENTRY_SIZE;
+	__m256i n01 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) p)),
+					      _mm_loadu_si128((const __m128i*) (p + DIRSEARCH_ENTRY_SIZE)), 1);
+	__m256i n23 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (p + 2*DIRSEARCH_ENTRY_SIZE))),
+					      _mm_loadu_si128((const __m128i*) (p + 3*DIRSEARCH_ENTRY_SIZE)), 1);
+	unsigned int m01 = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(n01, k2));
+	unsigned int m23 = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(n23, k2));
+	// chaque nom donne 16 bits, egaux a 0xFFFF ssi le nom correspond (voir la version SSE2)
+	unsigned int m0 = m01 & 0xFFFF, m1 = m01 >> 16, m2 = m23 & 0xFFFF, m3 = m23 >> 16;
+	if((((m0 + 1) | (m1 + 1) | (m2 + 1) | (m3 + 1)) & 0x10000) == 0) {
+	    continue;
+	}
+	if(m0 == 0xFFFF) return i;
+	if(m1 == 0xFFFF) return i + 1;
+	if(m2 == 0xFFFF) return i + 2;
+	return i + 3;
+    }
+#else
+    for(; i + 3 < nbEntries; i += 4) {
+	const char* p = e + i*DIRSEARCH_ENTRY_SIZE;
+	int m0 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) p), k));
+	int m1 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + DIRSEARCH_ENTRY_SIZE)), k));
+	int m2 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + 2*DIRSEARCH_ENTRY_SIZE)), k));
+	int m3 = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + 3*DIRSEARCH_ENTRY_SIZE)), k));
+	// m vaut 0xFFFF (16 octets egaux) ssi m+1 a son bit 16 a 1: un seul test pour les quatre
+	if((((m0 + 1) | (m1 + 1) | (m2 + 1) | (m3 + 1)) & 0x10000) == 0) {
+	    continue;
+	}
+	if(m0 == 0xFFFF) return i;
+	if(m1 == 0xFFFF) return i + 1;
+	if(m2 == 0xFFFF) return i + 2;
+	if(m3 == 0xFFFF) return i + 3;
+    }
+#endif
+    for(; i < nbEntries; i++) {
+	__m128i name = _mm_loadu_si128((const __m128i*) (e + i*DIRSEARCH_ENTRY_SIZE));
+	if(_mm_movemask_epi8(_mm_cmpeq_epi8(name, k)) == 0xFFFF) {
+	    return i;
+	}
+    }
+    return -1;
+#else
+    return DirSearch_Block_Scalar(entries, nbEntries, key);
+#endif
+}
@@ -0,0 +1,24 @@
+//
+// DirSearch.h
+//
+// Recherche d un nom dans un bloc d entrees de repertoire de taille fixe
+// (nom de 16 octets complete par des 0, suivi de l index de l inode)
+//
+
+#ifndef __DirSearch_H__
+#define __DirSearch_H__
+
+// parametres fixe
+#define DIRSEARCH_NAME_SIZE   16
+#define DIRSEARCH_ENTRY_SIZE  20
+
+//construit la cle de recherche: le nom complete par des 0 sur 16 octets
+void DirSearch_MakeKey(char* key, const char* name);
+
+//retourne la position de la cle dans les nbEntries entrees, -1 si absente
+//version vectorielle (AVX2 ou SSE2 selon la compilation)
+int DirSearch_Block(const void* entries, int nbEntries, const char* key);
+//version scalaire, utilisee quand le processeur n a pas de SSE2
+int DirSearch_Block_Scalar(const void* entries, int nbEntries, const char* key);
+
+#endif // __DirSearch_H__
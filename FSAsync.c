@@ -0,0 +1,254 @@
+#include "LibFS.h"
+#include <pthread.h>
+
+// file de soumission et file de terminaison sont deux anneaux de taille fixe;
+// un travailleur prend toutes les demandes en attente (au plus FS_ASYNC_BATCH)
+// et les execute d un bloc en tenant le verrou du FS, qui n est pas reentrant
+
+#define FS_ASYNC_BATCH 32
+
+static fs_request_t _sq[FS_ASYNC_QUEUE_SIZE];
+static int _sq_head = 0;
+static int _sq_count = 0;
+static fs_completion_t _cq[FS_ASYNC_QUEUE_SIZE];
+static int _cq_head = 0;
+static int _cq_count = 0;
+// demandes soumises pas encore reapees: borne la file de terminaison
+static int _in_flight = 0;
+
+static pthread_mutex_t _queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _sq_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _cq_cond = PTHREAD_COND_INITIALIZER;
+// toutes les operations du FS passent par ce verrou
+static pthread_mutex_t _fs_lock = PTHREAD_MUTEX_INITIALIZER;
+// 1 dans le thread qui tient _fs_lock par FS_Lock
+static __thread int _holds_fs_lock = 0;
+// demarrage et arret des travailleurs: le premier FS_Submit peut venir de
+// plusieurs threads a la fois
+static pthread_mutex_t _start_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t _workers[FS_ASYNC_MAX_WORKERS];
+static int _nb_workers = 0;
+static int _stopping = 0;
+
+/*
+ * Execution d une demande, verrou du FS tenu
+ */
+static void _fs_async_run(const fs_request_t* req, fs_completion_t* cqe)
+{
+    osErrno = E_GENERAL;
+    switch(req->op) {
+    case FS_OP_READ:
+	cqe->result = File_PRead(req->fd, req->buffer, req->size, req->offset);
+	break;
+    case FS_OP_WRITE:
+	cqe->result = File_PWrite(req->fd, req->buffer, req->size, req->offset);
+	break;
+    case FS_OP_CREATE:
+	cqe->result = File_Create(req->path);
+	break;
+    default:
+	cqe->result = -1;
+	break;
+    }
+    cqe->error = cqe->result == -1 ? osErrno : 0;
+    cqe->user_data = req->user_data;
+}
+
+static void* _fs_async_worker(void* arg)
+{
+    (void) arg;
+    fs_request_t batch[FS_ASYNC_BATCH];
+    fs_completion_t done[FS_ASYNC_BATCH];
+    for(;;) {
+	pthread_mutex_lock(&_queue_lock);
+	while(_sq_count == 0 && !_stopping) {
+	    pthread_cond_wait(&_sq_cond, &_queue_lock);
+	}
+	if(_sq_count == 0) {
+	    pthread_mutex_unlock(&_queue_lock);
+	    return NULL;
+	}
+	int n = 0;
+	while(_sq_count > 0 && n < FS_ASYNC_BATCH) {
+	    batch[n++] = _sq[_sq_head];
+	    _sq_head = (_sq_head + 1) % FS_ASYNC_QUEUE_SIZE;
+	    _sq_count--;
+	}
+	pthread_mutex_unlock(&_queue_lock);
+
+	// le lot passe d un seul tenant sur la couche disque
+	pthread_mutex_lock(&_fs_lock);
+	for(int i = 0; i < n; i++) {
+	    _fs_async_run(&batch[i], &done[i]);
+	}
+	pthread_mutex_unlock(&_fs_lock);
+
+	// _in_flight garantit la place dans la file de terminaison
+	pthread_mutex_lock(&_queue_lock);
+	for(int i = 0; i < n; i++) {
+	    _cq[(_cq_head + _cq_count) % FS_ASYNC_QUEUE_SIZE] = done[i];
+	    _cq_count++;
+	}
+	pthread_cond_broadcast(&_cq_cond);
+	pthread_mutex_unlock(&_queue_lock);
+    }
+}
+
+/*
+ * Les demandes deja soumises sont executees, puis les travailleurs
+ * s arretent; _start_lock tenu
+ */
+static void _fs_async_stop()
+{
+    pthread_mutex_lock(&_queue_lock);
+    _stopping = 1;
+    pthread_cond_broadcast(&_sq_cond);
+    pthread_mutex_unlock(&_queue_lock);
+    for(int i = 0; i < _nb_workers; i++) {
+	pthread_join(_workers[i], NULL);
+    }
+    _nb_workers = 0;
+}
+
+/*
+ * Demarrage de workers travailleurs, _start_lock tenu
+ */
+static int _fs_async_start(int workers)
+{
+    pthread_mutex_lock(&_queue_lock);
+    _stopping = 0;
+    pthread_mutex_unlock(&_queue_lock);
+    for(int i = 0; i < workers; i++) {
+	if(pthread_create(&_workers[i], NULL, _fs_async_worker, NULL) != 0) {
+	    _fs_async_stop();
+	    osErrno = E_GENERAL;
+	    return -1;
+	}
+	_nb_workers++;
+    }
+    return 0;
+}
+
+/*
+ * FS_AsyncInit
+ *
+ * Demarrage de workers travailleurs (au plus FS_ASYNC_MAX_WORKERS)
+ */
+int FS_AsyncInit(int workers)
+{
+    if(workers < 1 || workers > FS_ASYNC_MAX_WORKERS) {
+	osErrno = E_GENERAL;
+	return -1;
+    }
+    pthread_mutex_lock(&_start_lock);
+    int ret = -1;
+    if(_nb_workers > 0) {
+	osErrno = E_GENERAL;
+    } else {
+	ret = _fs_async_start(workers);
+    }
+    pthread_mutex_unlock(&_start_lock);
+    return ret;
+}
+
+/*
+ * FS_AsyncShutdown
+ *
+ * Les demandes deja soumises sont executees, puis les travailleurs s arretent;
+ * les terminaisons restent a reaper
+ */
+int FS_AsyncShutdown()
+{
+    pthread_mutex_lock(&_start_lock);
+    _fs_async_stop();
+    pthread_mutex_unlock(&_start_lock);
+    return 0;
+}
+
+/*
+ * FS_Submit
+ *
+ * Mise en file de n demandes; retourne le nombre de demandes acceptees,
+ * moins que n si la file est pleine
+ */
+int FS_Submit(fs_request_t* reqs, int n)
+{
+    if(n < 0 || (n > 0 && reqs == NULL)) {
+	osErrno = E_GENERAL;
+	return -1;
+    }
+    pthread_mutex_lock(&_start_lock);
+    int started = _nb_workers > 0 || _fs_async_start(FS_ASYNC_DEFAULT_WORKERS) == 0;
+    pthread_mutex_unlock(&_start_lock);
+    if(!started) {
+	return -1;
+    }
+    pthread_mutex_lock(&_queue_lock);
+    int accepted = 0;
+    while(accepted < n && _in_flight < FS_ASYNC_QUEUE_SIZE) {
+	_sq[(_sq_head + _sq_count) % FS_ASYNC_QUEUE_SIZE] = reqs[accepted];
+	_sq_count++;
+	_in_flight++;
+	accepted++;
+    }
+    if(accepted > 0) {
+	pthread_cond_broadcast(&_sq_cond);
+    }
+    pthread_mutex_unlock(&_queue_lock);
+    return accepted;
+}
+
+/*
+ * FS_Reap
+ *
+ * Copie d au plus max terminaisons dans out; attend qu il y en ait au moins
+ * min (borne au nombre de demandes en cours). Retourne le nombre copie
+ * Les travailleurs ont besoin du verrou du FS: attendre en le tenant par
+ * FS_Lock bloquerait pour toujours, l appel echoue alors (E_GENERAL)
+ */
+int FS_Reap(fs_completion_t* out, int max, int min)
+{
+    if(max < 0 || min > max) {
+	osErrno = E_GENERAL;
+	return -1;
+    }
+    pthread_mutex_lock(&_queue_lock);
+    if(min > _in_flight) {
+	min = _in_flight;
+    }
+    if(_holds_fs_lock && _cq_count < min) {
+	pthread_mutex_unlock(&_queue_lock);
+	osErrno = E_GENERAL;
+	return -1;
+    }
+    while(_cq_count < min) {
+	pthread_cond_wait(&_cq_cond, &_queue_lock);
+    }
+    int n = 0;
+    while(_cq_count > 0 && n < max) {
+	out[n++] = _cq[_cq_head];
+	_cq_head = (_cq_head + 1) % FS_ASYNC_QUEUE_SIZE;
+	_cq_count--;
+	_in_flight--;
+    }
+    pthread_mutex_unlock(&_queue_lock);
+    return n;
+}
+
+/*
+ * FS_Lock / FS_Unlock
+ *
+ * Un appel synchrone pendant que des demandes sont en cours doit tenir ce verrou
+ */
+void FS_Lock()
+{
+    pthread_mutex_lock(&_fs_lock);
+    _holds_fs_lock = 1;
+}
+
+void FS_Unlock()
+{
+    _holds_fs_lock = 0;
+    pthread_mutex_unlock(&_fs_lock);
+}
@@ -1,5 +1,7 @@
 #include "LibFS.h"
 #include "Disque.h"
+#include "Dentry.h"
+#include "Cache.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -40,13 +42,13 @@ static char Dmap[1024];
 
 int  loadmaps()// pour lire les bitmaps et les mettre dans les variables statiques
 {
-  if ( (Disk_Read(1, Imap)  == -1) || (Disk_Read(2, Imap+512)  == -1) ) {
-    printf("Disk_Read() Imap failed\n");
+  if ( (Cache_Read(1, Imap)  == -1) || (Cache_Read(2, Imap+512)  == -1) ) {
+    printf("Cache_Read() Imap failed\n");
     osErrno = E_GENERAL;
     return -1;
   }
-  if ( (Disk_Read(3, Dmap)  == -1) || (Disk_Read(4, Dmap+512)  == -1) ) {
-    printf("Disk_Read() Dmap failed\n");
+  if ( (Cache_Read(3, Dmap)  == -1) || (Cache_Read(4, Dmap+512)  == -1) ) {
+    printf("Cache_Read() Dmap failed\n");
     osErrno = E_GENERAL;
     return -1;
   }
@@ -55,13 +57,13 @@ int  loadmaps()// pour lire les bitmaps et les mettre dans les variables statiqu
 
 int  savemaps()// pour sauvegarder les variables statiques sur le disque virtuel
 {
-  if ( (Disk_Write(1, Imap)  == -1) || (Disk_Write(2, Imap+512)  == -1) ) {
-    printf("Disk_Read() Imap failed\n");
+  if ( (Cache_Write(1, Imap)  == -1) || (Cache_Write(2, Imap+512)  == -1) ) {
+    printf("Cache_Read() Imap failed\n");
     osErrno = E_GENERAL;
     return -1;
   }
-  if ( (Disk_Write(3, Dmap)  == -1) || (Disk_Write(4, Dmap+512)  == -1) ) {
-    printf("Disk_Read() Dmap failed\n");
+  if ( (Cache_Write(3, Dmap)  == -1) || (Cache_Write(4, Dmap+512)  == -1) ) {
+    printf("Cache_Read() Dmap failed\n");
     osErrno = E_GENERAL;
     return -1;
   }
@@ -169,8 +171,8 @@ inode  readinode( int I)// retourne l'inode d'indice I
   int p = I % INODE_PER_BLOCK;    // indice interne
   inode sect_in[INODE_PER_BLOCK];  //bloc d'inodes
 
-  if  (Disk_Read(INODE_OFFSET+ind, (char *) sect_in)  == -1 ) {
-    printf("Disk_Read() Itable failed\n");
+  if  (Cache_Read(INODE_OFFSET+ind, (char *) sect_in)  == -1 ) {
+    printf("Cache_Read() Itable failed\n");
     osErrno = E_GENERAL;
     exit( -1);
   }
@@ -183,15 +185,15 @@ int  saveinode(inode i, int I)// modifie l'inode d'indice I
   int p = I % INODE_PER_BLOCK;    // indice interne
   inode sect_in[INODE_PER_BLOCK];  //bloc d'inodes
 
-  if  (Disk_Read(INODE_OFFSET+ind, (char *) sect_in)  == -1 ) {
-    printf("Disk_Read() Itable failed\n");
+  if  (Cache_Read(INODE_OFFSET+ind, (char *) sect_in)  == -1 ) {
+    printf("Cache_Read() Itable failed\n");
     osErrno = E_GENERAL;
     return -1;
   }
 
   sect_in[p] = i;
-  if  (Disk_Write(INODE_OFFSET+ind, (char *) sect_in)  == -1 ) {
-    printf("Disk_Write() Itable failed\n");
+  if  (Cache_Write(INODE_OFFSET+ind, (char *) sect_in)  == -1 ) {
+    printf("Cache_Write() Itable failed\n");
     osErrno = E_GENERAL;
     return -1;
   }
@@ -224,8 +226,8 @@ int addDirEntry(int datablock, int numEntry, char* fileName, int inode)//Ajoute
 {
   dir_entry sect_in[DIR_ENTRY_PER_BLOCK];  //bloc d'entr de disseur
 
-  if (Disk_Read(DATA_OFFSET+datablock, (char *) sect_in)  == -1 ) {
-    printf("Disk_Read() Dtable failed\n");
+  if (Cache_Read(DATA_OFFSET+datablock, (char *) sect_in)  == -1 ) {
+    printf("Cache_Read() Dtable failed\n");
     osErrno = E_GENERAL;
     return -1;
   }
@@ -235,8 +237,8 @@ int addDirEntry(int datablock, int numEntry, char* fileName, int inode)//Ajoute
   entry.inode = inode;
 
   sect_in[numEntry] = entry;
-  if  (Disk_Write(DATA_OFFSET+datablock, (char *) sect_in)  == -1 ) {
-    printf("Disk_Write() Dtable failed\n");
+  if  (Cache_Write(DATA_OFFSET+datablock, (char *) sect_in)  == -1 ) {
+    printf("Cache_Write() Dtable failed\n");
     osErrno = E_GENERAL;
     return -1;
   }
@@ -244,138 +246,169 @@ int addDirEntry(int datablock, int numEntry, char* fileName, int inode)//Ajoute
   return 0;
 }
 
+unsigned int hashName(char* name)//Hachage FNV-1a du nom, donne la case de depart de l entree
+{
+  unsigned int hash = 2166136261u;
+  for(int i = 0; i < MAX_FILE_NAME && name[i] != '\0'; i++)
+    {
+      hash ^= (unsigned char) name[i];
+      hash *= 16777619u;
+    }
+  return hash;
+}
+
+int dirSlots(inode* dir)//Nombre de cases d entrees des blocs alloues au dossier
+{
+  int n = 0;
+  while(n < NUMBER_OF_DATA_BLOCK && dir->adr[n] != -1)
+    {
+      n++;
+    }
+  return n * DIR_ENTRY_PER_BLOCK;
+}
+
+//Les entrees sont rangees par adressage ouvert: la case de depart vient du hachage du nom
+//puis on avance case par case. Une case jamais utilisee (file NULL, inode 0) arrete la
+//recherche, une case liberee (file NULL, inode -1) ne l arrete pas.
 int addDirEntry_last(inode* dir, char* filename, int inode)
 {
-  int placed = 0;
-  int i = 0;
+  int slots = dirSlots(dir);
+  if(slots == 0)
+    {
+      return -1;
+    }
 
-  while(i < NUMBER_OF_DATA_BLOCK && placed == 0)
+  int start = hashName(filename) % slots;
+  char buffer[SECTOR_SIZE];
+  int loaded = -1;
+
+  for(int n = 0; n < slots; n++)
     {
-      if(dir->adr[i] != -1)
+      int slot = (start + n) % slots;
+      int i = slot / DIR_ENTRY_PER_BLOCK;
+      if(i != loaded)
 	{
-	  char buffer[SECTOR_SIZE];
-
-	  if(Disk_Read(DATA_OFFSET + dir->adr[i], buffer) == -1)
+	  if(Cache_Read(DATA_OFFSET + dir->adr[i], buffer) == -1)
 	    {
-	      printf("Disk_Read() failed\n");
+	      printf("Cache_Read() failed\n");
 	      osErrno = E_CREATE;
 	      return -1;
 	    }
+	  loaded = i;
+	}
 
-	  int j = 0;
-	  while(j < DIR_ENTRY_PER_BLOCK && placed == 0)
-	    {
-	      dir_entry* entry = (dir_entry*) (buffer + (j * sizeof(dir_entry)));
+      dir_entry* entry = (dir_entry*) (buffer + ((slot % DIR_ENTRY_PER_BLOCK) * sizeof(dir_entry)));
+      if(entry->file == NULL)
+	{
+	  entry->file = filename;
+	  entry->inode = inode;
 
-	      if(entry->inode == 0)
-		{
-		  entry->file = filename;
-		  entry->inode = inode;
-
-		  if(Disk_Write(DATA_OFFSET + dir->adr[i], buffer) == -1)
-		    {
-		      printf("Disk_Write() failed\n");
-		      osErrno = E_CREATE;
-		      return -1;
-		    }
-
-		  dir->sz += DIR_ENTRY_SIZE;
-		  placed = 1;
-		}
-	      j++;
+	  if(Cache_Write(DATA_OFFSET + dir->adr[i], buffer) == -1)
+	    {
+	      printf("Cache_Write() failed\n");
+	      osErrno = E_CREATE;
+	      return -1;
 	    }
+
+	  dir->sz += DIR_ENTRY_SIZE;
+	  return 0;
 	}
-      i++;
     }
 
-  return placed == 0 ? -1 : 0;
+  return -1;
 }
 
 int delDirEntry(inode* dir, char* filename)
 {
-  int removed = 0;
-  int i = 0;
+  int slots = dirSlots(dir);
+  if(slots == 0)
+    {
+      return -1;
+    }
+
+  int start = hashName(filename) % slots;
+  char buffer[SECTOR_SIZE];
+  int loaded = -1;
 
-  while(i < NUMBER_OF_DATA_BLOCK && removed == 0)
+  for(int n = 0; n < slots; n++)
     {
-      if(dir->adr[i] != -1)
+      int slot = (start + n) % slots;
+      int i = slot / DIR_ENTRY_PER_BLOCK;
+      if(i != loaded)
 	{
-	  char buffer[SECTOR_SIZE];
-
-	  if(Disk_Read(DATA_OFFSET + dir->adr[i], buffer) == -1)
+	  if(Cache_Read(DATA_OFFSET + dir->adr[i], buffer) == -1)
 	    {
-	      printf("Disk_Read() failed\n");
+	      printf("Cache_Read() failed\n");
 	      osErrno = E_CREATE;
 	      return -1;
 	    }
+	  loaded = i;
+	}
 
-	  int j = 0;
-	  while(j < DIR_ENTRY_PER_BLOCK && removed == 0)
-	    {
-	      dir_entry* entry = (dir_entry*) (buffer + (j * sizeof(dir_entry)));
+      dir_entry* entry = (dir_entry*) (buffer + ((slot % DIR_ENTRY_PER_BLOCK) * sizeof(dir_entry)));
+      if(entry->file == NULL && entry->inode == 0)
+	{
+	  return -1;//case jamais utilisee: le nom n est pas dans le dossier
+	}
+      if(entry->file != NULL && strcmp(filename, entry->file) == 0)
+	{
+	  entry->file = NULL;
+	  entry->inode = -1;//case liberee, la recherche continue apres elle
 
-	      if(strcmp(filename, entry->file) == 0)
-		{
-		  entry->file = NULL;
-		  entry->inode = 0;
-
-		  if(Disk_Write(DATA_OFFSET + dir->adr[i], buffer) == -1)
-		    {
-		      printf("Disk_Write() failed\n");
-		      osErrno = E_CREATE;
-		      return -1;
-		    }
-
-		  dir->sz -= DIR_ENTRY_SIZE;
-		  removed = 1;
-		}
-	      j++;
+	  if(Cache_Write(DATA_OFFSET + dir->adr[i], buffer) == -1)
+	    {
+	      printf("Cache_Write() failed\n");
+	      osErrno = E_CREATE;
+	      return -1;
 	    }
+
+	  dir->sz -= DIR_ENTRY_SIZE;
+	  return 0;
 	}
-      i++;
     }
 
-  return removed == 0 ? -1 : 0;
+  return -1;
 }
 
 int getInodeForName(inode dir, char* filename)
 {
-  int find = 0;
-  int inode = -1;
+  int slots = dirSlots(&dir);
+  if(slots == 0 || filename == NULL)
+    {
+      return -1;
+    }
 
-  int i = 0;
+  int start = hashName(filename) % slots;
+  char buffer[SECTOR_SIZE];
+  int loaded = -1;
 
-  while(i < NUMBER_OF_DATA_BLOCK && find == 0)
+  for(int n = 0; n < slots; n++)
     {
-      if(dir.adr[i] != -1)
+      int slot = (start + n) % slots;
+      int i = slot / DIR_ENTRY_PER_BLOCK;
+      if(i != loaded)
 	{
-	  char buffer[SECTOR_SIZE];
-	  if(Disk_Read(DATA_OFFSET + dir.adr[i], buffer) == -1)
+	  if(Cache_Read(DATA_OFFSET + dir.adr[i], buffer) == -1)
 	    {
-	      printf("Disk_Read() failded\n");
+	      printf("Cache_Read() failded\n");
 	      osErrno = E_CREATE;
 	      return -1;
 	    }
+	  loaded = i;
+	}
 
-	  int j = 0;
-	  while(j < DIR_ENTRY_PER_BLOCK && find == 0)
-	    {
-	      dir_entry* entry = (dir_entry*) (buffer + (j * sizeof(dir_entry)));
-	      if(entry->file != NULL && filename != NULL)
-		{
-		  if(strcmp(entry->file, filename) == 0)
-		    {
-		      inode = entry->inode;
-		      find = 1;
-		    }
-		}
-	      j++;
-	    }
+      dir_entry* entry = (dir_entry*) (buffer + ((slot % DIR_ENTRY_PER_BLOCK) * sizeof(dir_entry)));
+      if(entry->file == NULL && entry->inode == 0)
+	{
+	  return -1;
+	}
+      if(entry->file != NULL && strcmp(entry->file, filename) == 0)
+	{
+	  return entry->inode;
 	}
-      i++;
     }
 
-  return inode;
+  return -1;
 }
 
 int findDirInode(char** folders, int folder)
@@ -383,8 +416,13 @@ int findDirInode(char** folders, int folder)
   int in = ROOT_INODE;
   for(int i = 1; i <= folder; i++)
     {
-      inode I = readinode(in);
-      in = getInodeForName(I, folders[i]);
+      int parent = in;
+      if(!Dentry_Lookup(parent, folders[i], &in))//Pas dans le cache, lecture du dossier
+	{
+	  inode I = readinode(parent);
+	  in = getInodeForName(I, folders[i]);
+	  Dentry_Insert(parent, folders[i], in);
+	}
       if(in == -1)
 	{
 	  printf("Dir Not Found\n");
@@ -445,7 +483,7 @@ int format()//Formate le disque dur
 
   //Ecriture Magic Number
   sprintf(&superblock[SECTOR_SIZE - MAGIC_NUMBER_BYTES], "0%i", MAGIC_NUMBER);
-  Disk_Write(0, superblock);
+  Cache_Write(0, superblock);
 
   //Load Bitmaps
   if(loadmaps() == -1)
@@ -518,6 +556,8 @@ int FS_Boot(char *path)
   printf("My FS\n");
   printf("FS_Boot %s\n", path);
 
+  Dentry_Reset();
+
   //Init
   if (Disk_Init() == -1)
     {
@@ -525,6 +565,12 @@ int FS_Boot(char *path)
       osErrno = E_GENERAL;
       return -1;
     }
+  if(Cache_Reset() == -1)//Rien de l ancienne image ne doit rester en cache
+    {
+      printf("Cache_Reset() failed\n");
+      osErrno = E_GENERAL;
+      return -1;
+    }
 
   //Load
   if(Disk_Load(path) == -1)
@@ -555,9 +601,9 @@ int FS_Boot(char *path)
 
   char buffer[sizeof(Sector)];
   //Lecture superblock
-  if(Disk_Read(0, buffer) == -1)
+  if(Cache_Read(0, buffer) == -1)
     {
-      printf("Disk_Read() failed\n");
+      printf("Cache_Read() failed\n");
       osErrno = E_GENERAL;
       return -1;
     }
@@ -593,6 +639,12 @@ int FS_Sync()
       osErrno = E_GENERAL;
       return -1;
     }
+  if(Cache_Flush() == -1)//Ecriture des secteurs modifies
+    {
+      printf("Cache_Flush() failed\n");
+      osErrno = E_GENERAL;
+      return -1;
+    }
   if(Disk_Save(imageFile) == -1)//Save Disk
     {
       printf("Disk_Save() failed\n");
@@ -709,6 +761,7 @@ int Dir_Create(char *path)
 	  osErrno = E_CREATE;
 	  return -1;
 	}
+      Dentry_Insert(parentInode, folders[length-1], index);
 
       if(saveinode(parent, parentInode) == -1)
 	{
@@ -780,9 +833,9 @@ int Dir_Read(char *path, void *buffer, int size)
       if(i.adr[j] != -1)
 	{
 	  char block[SECTOR_SIZE];
-	  if(Disk_Read(DATA_OFFSET + i.adr[j], block) == -1)
+	  if(Cache_Read(DATA_OFFSET + i.adr[j], block) == -1)
 	    {
-	      printf("Disk_Read() failed\n");
+	      printf("Cache_Read() failed\n");
 	      osErrno = E_CREATE;
 	      return -1;
 	    }
@@ -790,7 +843,7 @@ int Dir_Read(char *path, void *buffer, int size)
 	  for(int k = 0; k < DIR_ENTRY_PER_BLOCK; k++)
 	    {
 	      dir_entry* entry = (dir_entry*) (block + (k * sizeof(dir_entry)));
-	      if(entry->inode != 0)
+	      if(entry->file != NULL)
 		{
 		  strcpy(&bufferAlias[j * DIR_ENTRY_SIZE], entry->file);
 		  bufferAlias[j * DIR_ENTRY_SIZE + MAX_FILE_NAME] = entry->inode;
@@ -850,9 +903,9 @@ int Dir_Unlink(char *path)
     {
       if(dir.adr[i] != -1)
     	{
-	  if(Disk_Write(dir.adr[i], blank) == -1)
+	  if(Cache_Write(dir.adr[i], blank) == -1)
 	    {
-	      printf("Disk_Write() failed\n");
+	      printf("Cache_Write() failed\n");
 	      osErrno = E_GENERAL;
 	      return -1;
 	    }
@@ -884,6 +937,7 @@ int Dir_Unlink(char *path)
       osErrno = E_GENERAL;
       return -1;
     }
+  Dentry_Insert(Parent, folders[length-1], DENTRY_NEGATIVE);
 
   if(saveinode(parent, Parent) == -1)
     {
@@ -31,6 +31,9 @@ typedef enum {
     
 int FS_Boot(char *path);
 int FS_Sync();
+// mode journal du volume (enable a 1): les blocs de donnees sont alloues a la suite
+// du dernier alloue plutot qu au premier libre, pour des ajouts sequentiels sur le disque
+int FS_SetLogMode(int enable);
 
 // file ops
 int File_Create(char *file);
@@ -40,12 +43,107 @@ int File_Write(int fd, void *buffer, int size);
 int File_Seek(int fd, int offset);
 int File_Close(int fd);
 int File_Unlink(char *file);
+// regroupement des petites ecritures sequentielles du descripteur (enable a 1),
+// ecrites par blocs entiers au remplissage, File_Seek, File_Read, File_Close et FS_Sync
+int File_SetWriteBuffer(int fd, int enable);
+// lecture sans copie: chaque morceau pointe dans un bloc du fichier garde en cache
+// jusqu a File_ReleaseView; retourne le nombre de morceaux remplis
+typedef struct file_view {
+    const char *base;
+    int len;
+} file_view_t;
+int File_ReadView(int fd, int offset, int len, file_view_t *iov, int iovcnt);
+void File_ReleaseView(file_view_t *iov, int iovcnt);
+// fenetre sur les octets [offset, offset+len) du fichier, lue et modifiee directement;
+// les modifications arrivent dans le fichier au plus tard au File_MapSync ou File_Unmap
+void *File_Map(int fd, int offset, int len);
+int File_MapSync(void *addr);
+int File_Unmap(void *addr);
+// copie d un fichier dans un autre sans recopier les donnees: les blocs sont partages
+// et copies a la premiere ecriture. File_Clone remplace tout le contenu de dst,
+// File_CopyRange copie len octets et retourne le nombre d octets copies
+int File_Clone(int src, int dst);
+int File_CopyRange(int src, int srcOffset, int dst, int dstOffset, int len);
+// nouvelle taille du fichier, les blocs au dela sont liberes
+int File_Truncate(int fd, int size);
+// reservation des blocs de [offset, offset+len), consecutifs si possible
+int File_Allocate(int fd, int offset, int len);
+// lecture et ecriture a une position donnee; la position du descripteur ne change pas
+int File_PRead(int fd, void *buffer, int size, int offset);
+int File_PWrite(int fd, void *buffer, int size, int offset);
+// lecture et ecriture a morceaux multiples a la position du descripteur: une seule
+// lecture de l inode et une seule mise a jour par appel; retourne le nombre d octets
+typedef struct file_iovec {
+    void *base;
+    int len;
+} file_iovec_t;
+int File_ReadV(int fd, file_iovec_t *iov, int iovcnt);
+int File_WriteV(int fd, file_iovec_t *iov, int iovcnt);
+// creation de n fichiers dans le repertoire dir en une seule transaction
+int File_CreateBatch(char *dir, char **names, int n);
 
 // directory ops
 int Dir_Create(char *path);
 int Dir_Size(char *path);
 int Dir_Read(char *path, void *buffer, int size);
 int Dir_Unlink(char *path);
+// repertoire dont les entrees restent triees par nom (arbre B+)
+int Dir_CreateOrdered(char *path);
+// au plus count entrees triees par nom, a partir du premier nom apres after
+// (NULL ou "" pour le debut), retourne le nombre d entrees copiees
+int Dir_ReadFrom(char *path, char *after, void *buffer, int count);
+
+// lecture d un repertoire entree par entree, un bloc a la fois
+// Dir_Next copie une entree (nom sur 16 octets puis index de l inode) dans entry
+// et retourne 1, 0 a la fin du repertoire, -1 en cas d erreur
+int Dir_OpenIter(char *path);
+int Dir_Next(int it, void *entry);
+int Dir_CloseIter(int it);
+
+// repertoires ouverts: le chemin n est resolu qu une fois, les fonctions *At
+// ne cherchent que le nom donne dans le repertoire du handle
+int Dir_Open(char *path);
+int Dir_OpenAt(int dh, char *name);
+int Dir_Close(int dh);
+int Dir_ReadAt(int dh, void *buffer, int size);
+int File_CreateAt(int dh, char *name);
+int File_OpenAt(int dh, char *name);
+
+// async ops: les demandes soumises sont executees par un groupe de travailleurs,
+// par lots; buffer et path doivent rester valides jusqu a la terminaison
+#define FS_ASYNC_QUEUE_SIZE 256
+#define FS_ASYNC_MAX_WORKERS 16
+#define FS_ASYNC_DEFAULT_WORKERS 2
+typedef enum {
+    FS_OP_READ,   // File_PRead(fd, buffer, size, offset)
+    FS_OP_WRITE,  // File_PWrite(fd, buffer, size, offset)
+    FS_OP_CREATE, // File_Create(path)
+} FS_Op_t;
+typedef struct fs_request {
+    FS_Op_t op;
+    int fd;
+    void *buffer;
+    int size;
+    int offset;
+    char *path;
+    void *user_data; // rendu tel quel dans la terminaison
+} fs_request_t;
+typedef struct fs_completion {
+    void *user_data;
+    int result; // valeur de retour de l appel
+    int error;  // osErrno si result vaut -1
+} fs_completion_t;
+// demarrage explicite; sinon le premier FS_Submit demarre FS_ASYNC_DEFAULT_WORKERS travailleurs
+int FS_AsyncInit(int workers);
+int FS_AsyncShutdown();
+// retourne le nombre de demandes acceptees (la file est bornee a FS_ASYNC_QUEUE_SIZE)
+int FS_Submit(fs_request_t *reqs, int n);
+// attend au moins min terminaisons et en copie au plus max; echoue au lieu
+// d attendre si l appelant tient FS_Lock
+int FS_Reap(fs_completion_t *out, int max, int min);
+// a tenir autour des appels synchrones faits pendant que des demandes sont en cours
+void FS_Lock();
+void FS_Unlock();
 
 #endif 
 /* __LibFS_h__ */
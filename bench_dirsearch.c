@@ -0,0 +1,111 @@
+/*
+ * Micro benchmark de la recherche d un nom dans un bloc de repertoire plein
+ *
+ *   gcc -O2 -o bench_dirsearch bench_dirsearch.c DirSearch.c
+ *   gcc -O2 -mavx2 -o bench_dirsearch bench_dirsearch.c DirSearch.c
+ *
+ * compare l ancienne boucle de _lookup_directory_entry (un strcmp par entree),
+ * la version scalaire (memcmp de 16 octets) et la version vectorielle
+ */
+#include "DirSearch.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ENTRIES 25
+#define ROUNDS 2000000
+
+typedef struct __attribute__((__packed__))  directory_entry {
+char name[16] ;
+int index ;
+} directory_entry_t ;
+
+static directory_entry_t bloc[ENTRIES];
+static volatile int sink;
+
+//la boucle de _lookup_directory_entry avant l index hache
+static int _lookup_strcmp(const directory_entry_t* dirContent, int numberOfEntries, const char* entryName)
+{
+    for(int i = 0 ; i < numberOfEntries; i++)
+    {
+        if( strcmp(dirContent[i].name,entryName) == 0 )
+        {
+            return dirContent[i].index;
+        }
+    }
+    return -1;
+}
+
+static double _now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+#define BEST_OF 5
+
+//temps moyen en ns par recherche, meilleur de BEST_OF mesures
+//la cle est construite une fois par recherche, comme dans _dir_find_slot
+static double _time_strcmp(const char* name)
+{
+    double best = 1e30;
+    for(int b = 0; b < BEST_OF; b++)
+    {
+        double t0 = _now();
+        for(int r = 0; r < ROUNDS; r++)
+        {
+            sink = _lookup_strcmp(bloc, ENTRIES, name);
+        }
+        double t = (_now() - t0) / ROUNDS;
+        best = t < best ? t : best;
+    }
+    return best;
+}
+
+static double _time_block(int (*search)(const void*, int, const char*), const char* name)
+{
+    char key[DIRSEARCH_NAME_SIZE];
+    double best = 1e30;
+    for(int b = 0; b < BEST_OF; b++)
+    {
+        double t0 = _now();
+        for(int r = 0; r < ROUNDS; r++)
+        {
+            DirSearch_MakeKey(key, name);
+            sink = search(bloc, ENTRIES, key);
+        }
+        double t = (_now() - t0) / ROUNDS;
+        best = t < best ? t : best;
+    }
+    return best;
+}
+
+static void _run(const char* label, const char* name)
+{
+    printf("%-8s strcmp %6.1f ns  scalaire %6.1f ns  vectoriel %6.1f ns\n", label,
+           _time_strcmp(name), _time_block(DirSearch_Block_Scalar, name), _time_block(DirSearch_Block, name));
+}
+
+int main()
+{
+    //un bloc plein de noms qui partagent un long prefixe, le pire cas pour strcmp
+    memset(bloc, 0, sizeof(bloc));
+    for(int i = 0; i < ENTRIES; i++)
+    {
+        snprintf(bloc[i].name, sizeof(bloc[i].name), "spool_msg_%05d", i);
+        bloc[i].index = i + 1;
+    }
+#if defined(__AVX2__)
+    printf("DirSearch_Block: AVX2\n");
+#elif defined(__SSE2__)
+    printf("DirSearch_Block: SSE2\n");
+#else
+    printf("DirSearch_Block: scalaire\n");
+#endif
+    _run("debut", "spool_msg_00000");
+    _run("milieu", "spool_msg_00012");
+    _run("fin", "spool_msg_00024");
+    _run("absent", "spool_msg_99999");
+    return 0;
+}
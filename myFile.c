@@ -1,8 +1,12 @@
 #include "LibFS.h"
 #include "Disque.h"
+#include "Dentry.h"
+#include "DirSearch.h"
+#include "Cache.h"
 #include <stdio.h>
 #include <string.h>
 #include <alloca.h>
+#include <limits.h>
 
 // variable errno pour gerer les erreurs
 int osErrno;
@@ -10,10 +14,13 @@ int osErrno;
 //***
 
 static char* fileName ;
-#define MAX_INODES 8192;
+#define MAX_INODES 8192
 #define MAX_NAME_SIZE 16
-#define MAX_OPEN_FILES 255
+//la table des descripteurs grandit par doublement jusqu a MAX_OPEN_FILES
+#define MAX_OPEN_FILES 65536
+#define OPEN_FILES_INITIAL 256
 #define DATA_BLOCK_PER_INODE 30
+#define MAX_FILE_SIZE (DATA_BLOCK_PER_INODE * SECTOR_SIZE)
 
 typedef unsigned char byte;
 
@@ -38,7 +45,10 @@ typedef struct __attribute__((__packed__))  databloc_bitmap {
 } databloc_bitmap_t ;
 
 typedef struct __attribute__((__packed__))  superblock {
-byte unused[508] ;
+byte unused[496] ;
+int log_head ; // mode journal: 1 + prochain bloc de donnees a allouer, 0 hors mode journal
+int refcount_table ; // 1 + premier bloc de la table des partages, 0 si aucun bloc n a ete partage
+int version ; // version du format sur disque
 int magicnumber ;
 } superblock_t ;
 
@@ -47,27 +57,137 @@ char name[16] ;
 int index ;
 } directory_entry_t ;
 
+//un bloc de repertoire est un seau de la table de hachage: 25 entrees (500 octets) + entete
+#define DIR_ENTRIES_PER_BLOC 25
+typedef struct __attribute__((__packed__))  directory_bloc {
+directory_entry_t entries[DIR_ENTRIES_PER_BLOC] ;
+int overflow ; // 1 si des entrees de ce seau ont ete placees dans les seaux suivants
+int used_map ; // bit i a 1 si l entree i est occupee: suivi des emplacements libres
+int unused ;
+} directory_bloc_t ;
+#define DIR_SLOTS_MASK ((1 << DIR_ENTRIES_PER_BLOC) - 1)
+
+//noeud de l arbre B+ d un repertoire ordonne: meme taille qu un seau
+// feuille: entrees triees par nom; noeud interne: entries[i].name est la plus petite
+// cle du fils i et entries[i].index le bloc du fils
+typedef struct __attribute__((__packed__))  btree_node {
+directory_entry_t entries[DIR_ENTRIES_PER_BLOC] ;
+int count ; // nombre d entrees utilisees, rangees au debut
+int leaf ; // 1 pour une feuille
+int next ; // feuille suivante dans l ordre des noms, -1 pour la derniere
+} btree_node_t ;
+#define BTREE_MAX_DEPTH 8
+//le dernier seau est fusionne quand les entrees tiendraient dans les autres seaux remplis
+// au tiers: un seau eclate plein ne refusionne pas apres quelques suppressions
+#define DIR_COMPACT_FILL 3
+
+//lecture anticipee: la fenetre double a chaque lecture qui suit la precedente
+// et retombe a 0 sur un acces aleatoire
+#define READAHEAD_MIN_BLOCKS 2
+#define READAHEAD_MAX_BLOCKS 16
+//tampon d ecriture d un descripteur: les petites ecritures sequentielles sont
+// regroupees et ecrites par blocs entiers
+#define WRITE_BUFFER_SIZE (4 * SECTOR_SIZE)
+
+//inode d un fichier ouvert, partage par ses descripteurs, handles et curseurs de repertoire:
+// _getinodeByNumber le rend sans relire le secteur et _setinodeByNumber le tient a
+// jour. Tant qu il existe, File_Unlink et Dir_Unlink refusent avec E_FILE_IN_USE
+typedef struct incore_inode {
+int num ; // numero de l inode
+int refcount ; // descripteurs, handles et curseurs ouverts sur l inode
+int valid ; // 0 si la copie doit etre relue (transaction annulee, nouvelle image)
+inode_bloc_t inode ;
+} incore_inode_t ;
+
 typedef struct __attribute__((__packed__))  descriptor_entry {
 int used;
 int inode_index ;
 int read_write_index ;
+int next_sequential ; // position ou commencerait la prochaine lecture sequentielle, -1 sinon
+int ra_window ; // taille de la fenetre de lecture anticipee en blocs, 0 si inactive
+int ra_next ; // premier bloc pas encore demande au cache
+char* wbuf ; // tampon d ecriture, NULL si le descripteur ecrit directement
+int wbuf_offset ; // position dans le fichier du premier octet du tampon
+int wbuf_len ; // octets en attente dans le tampon
+int next_free ; // descripteur libre suivant, -1 en fin de liste
+incore_inode_t* incore ; // inode garde en memoire tant que le descripteur est ouvert
 } descriptor_entry_t ;
 
 
 
-//tableau des fichiers ouverts
-static descriptor_entry_t _open_file_table [MAX_OPEN_FILES];
+//curseur de lecture d un repertoire: position (seau, entree) et copie du bloc courant
+#define MAX_OPEN_DIR_ITERS 64
+typedef struct dir_iterator {
+int used;
+int inode_index ;
+int bucket ; // seau courant (repertoire ordonne: bloc de la feuille courante, -1 a la fin)
+int slot ; // prochaine entree a lire dans le seau
+int loaded ; // 1 si bloc contient le seau courant
+int ordered ; // 1 pour un repertoire ordonne: on suit les feuilles chainees
+union {
+directory_bloc_t bloc ;
+btree_node_t node ;
+} ;
+} dir_iterator_t ;
+
+//repertoire ouvert: les operations *At partent de son inode sans reparcourir le chemin
+#define MAX_OPEN_DIRS 64
+typedef struct dir_handle {
+int used;
+int inode_index ;
+} dir_handle_t ;
+
+//fenetre de File_Map: un secteur retenu dans le cache quand la plage tient dans un
+// seul bloc alloue, sinon une copie privee ecrite au File_MapSync
+#define MAX_FILE_MAPS 16
+typedef struct file_map {
+int used;
+int fd ;
+int offset ;
+int len ;
+char* addr ; // adresse rendue par File_Map
+int direct ; // 1 si addr pointe dans le cache, 0 pour une copie
+char* orig ; // copie: contenu au File_Map ou au dernier File_MapSync
+} file_map_t ;
+
+//tableau des fichiers ouverts, de _open_file_capacity entrees; les entrees libres
+// sont chainees a partir de _free_descriptor
+static descriptor_entry_t* _open_file_table = NULL;
+static int _open_file_capacity = 0;
+static int _free_descriptor = -1;
+//inodes en memoire des fichiers ouverts, NULL pour un inode qui n est pas ouvert
+static incore_inode_t* _incore_inodes [MAX_INODES];
+//contenu d un trou de fichier (pointeur de bloc a -1)
+static const char _zero_bloc [SECTOR_SIZE];
+//tableau des repertoires ouverts
+static dir_handle_t _dir_handle_table [MAX_OPEN_DIRS];
+//tableau des curseurs de repertoire
+static dir_iterator_t _dir_iter_table [MAX_OPEN_DIR_ITERS];
+//tableau des fenetres de File_Map
+static file_map_t _file_map_table [MAX_FILE_MAPS];
 //indicateur pour savoir si le tableau des fichiers ouverts a ete initialise
 static int _is_open_filetable_init = 0;
 //magic number
 #define MAGICNUMBER 0xCAFEBAFE
+//version du format: 2 = repertoires indexes par hachage lineaire
+// 3 = carte des emplacements occupes dans l entete des seaux
+#define FS_VERSION 3
 //types pour les repertoires et les fichiers
 #define DIRECTORY_TYPE 1
 #define FILE_TYPE 0
+//repertoire dont les entrees sont rangees par nom dans un arbre B+ (racine dans pointers[0])
+#define ORDERED_DIRECTORY_TYPE 2
+
+//blocs partages entre fichiers (File_Clone, File_CopyRange): un compteur de 16 bits
+// par bloc de donnees, le nombre de fichiers qui le voient en plus du premier. La
+// table est prise dans les blocs de donnees au premier partage
+#define REFCOUNT_TABLE_BLOCS (8192 * 2 / SECTOR_SIZE)
+#define MAX_BLOC_SHARES 0xFFFF
 
 //des decalages poru le calcul des index inode
 #define INODE_OFFSET 5 // le numero de secteur pour les inodes
 #define DB_OFFSET (2048 + INODE_OFFSET) // le numero de secteur pour les databloc
+#define NB_DATA_BLOCS (NUM_SECTORS - DB_OFFSET) // blocs de donnees qui existent sur le disque
 
 /***
  *  Fonctions internes
@@ -93,30 +213,107 @@ int _get_containing_path_and_lastname(char* containingpath, char* lastToken, con
 
 //fonction pour obtenir l'inode partir d un path
 int _path_2_inode_number(const char* path);
+//recherche d un seul composant dans un repertoire, via le cache des entrees
+int _lookup_component(int dirIndex, const char* name);
+int _valid_entry_name(const char* name);
+//inode du repertoire designe par un handle de Dir_Open, -1 si le handle est invalide
+int _dir_handle_inode(int dh);
+int _open_dir_handle(int index);
+int _open_inode(int inodeindex);
+int _dir_read_index(int index, void *buffer, int size);
 //fonction pour obtenir l inode et l index a partir d un path
 int _path_2_inode(const char* path, inode_bloc_t* ptr, int* indexPtr);
+//comparaison de deux noms (tri des lots de creation)
+int _compare_names(const void* a, const void* b);
 
-//recherche d une entree dans le contenu d un repertoire
-int _exists_key(const char* keychain, const char* key, int size);
 //demande de creation d une nouvelle entree dans le contenu d un repertoire
 int _create_new_directory_entry(int index, const char* newEntryName, int entryType);
 
+//Groupe de fonctions pour l index hache des repertoires (hachage lineaire)
+// chaque pointeur de l inode repertoire est un seau, le nom choisit le seau
+unsigned int _name_hash(const char* name);
+int _dir_bucket_count(const inode_bloc_t* dir);
+int _dir_bucket_of(unsigned int hash, int nbBuckets);
+int _read_dir_bloc(int dbIndex, directory_bloc_t* bloc);
+int _write_dir_bloc(int dbIndex, directory_bloc_t* bloc);
+int _dir_find_slot(const inode_bloc_t* dir, const char* name, directory_bloc_t* bloc, int* bucketPtr, int* slotPtr);
+int _dir_free_slot(const directory_bloc_t* bloc);
+int _dir_split_bucket(inode_bloc_t* dir);
+int _dir_merge_last_bucket(inode_bloc_t* dir);
+int _dir_overflow_used(const inode_bloc_t* dir, int bucket);
+int _dir_rebuild(inode_bloc_t* dir, int target);
+int _dir_insert_entry(inode_bloc_t* dir, const char* name, int childIndex);
+int _dir_remove_entry(inode_bloc_t* dir, const char* name);
+//recherche d un nom quel que soit le format du repertoire
+int _dir_lookup(const inode_bloc_t* dir, const char* name);
+int _is_directory(int type);
+
+//Groupe de fonctions pour les repertoires ordonnes (arbre B+ sur le nom)
+int _read_btree_node(int dbIndex, btree_node_t* node);
+int _write_btree_node(int dbIndex, btree_node_t* node);
+int _btree_child_of(const btree_node_t* node, const char* key);
+int _btree_find_leaf(const inode_bloc_t* dir, const char* key, btree_node_t* leaf, int* path, int* childPos, int* depthPtr);
+int _btree_lookup(const inode_bloc_t* dir, const char* name);
+int _btree_insert(inode_bloc_t* dir, const char* name, int childIndex);
+int _btree_remove(inode_bloc_t* dir, const char* name);
+int _btree_free(int dbIndex);
+int _btree_read_from(const inode_bloc_t* dir, const char* after, directory_entry_t* out, int count);
+
 
 //fonction de creations des inodes, elles retournent l index
 int _create_new_directory_inode();
 int _create_new_file_inode();
+int _create_new_inode(int type);
 
 //recherche d une entree dans un repertoire
 int _lookup_directory_entry(const int inodeNum, const char* entryName);
 
 
 //Fonction pour ecrire le contenu d un fichier
-int _write_file_content(char* buffer, int size, inode_bloc_t* inode_ptr);
+int _write_file_content(const char* buffer, int offset, int size, inode_bloc_t* inode_ptr);
+//versions a morceaux multiples, une seule correspondance blocs par appel
+int _write_file_vec(const file_iovec_t* iov, int iovcnt, int offset, inode_bloc_t* inode_ptr);
+int _read_file_vec(const file_iovec_t* iov, int iovcnt, int start, const inode_bloc_t* inode_ptr);
+void _iov_scatter(const char* src, int n, const file_iovec_t* iov, int* idx, int* off);
+void _iov_gather(char* dest, int n, const file_iovec_t* iov, int* idx, int* off);
+int _iov_total(const file_iovec_t* iov, int iovcnt, int max);
+int _max(int i, int j);
+int _min(int i, int j);
+//detection des lectures sequentielles et lecture anticipee dans le cache
+void _readahead(descriptor_entry_t* desc, const inode_bloc_t* inode_ptr, int offset, int size);
+//ecriture de size octets a offset dans le fichier d inode donne, avec mise a jour de l inode
+int _write_at(int inodeIndex, const char* buffer, int offset, int size);
+//ecriture des octets en attente dans le tampon du descripteur
+int _flush_write_buffer(descriptor_entry_t* desc);
 int _copy_file_content(void* ptr, const inode_bloc_t* inode_ptr);
+//lecture des octets [start, end) du fichier, bornee a la fin du fichier
+int _read_file_content(char* buffer, int start, int end, const inode_bloc_t* inode_ptr);
+//fenetres de File_Map
+int _map_find(void* addr);
+int _map_sync(file_map_t* map);
 
 //Fonctions pour la lecture et ecriture des inodes sur le disque
 int _getinodeByNumber(const int num, inode_bloc_t* ptr);
 int _setinodeByNumber(const int num, inode_bloc_t* ptr);
+//inodes en memoire des fichiers ouverts
+incore_inode_t* _incore_acquire(int num);
+void _incore_release(incore_inode_t* in);
+void _incore_invalidate_sector(int sector);
+
+//Lecture et ecriture des secteurs de metadonnees (cartes, inodes, repertoires)
+int _meta_read(int sector, char* buffer);
+int _meta_write(int sector, char* buffer);
+//transaction de metadonnees: chaque secteur est lu au plus une fois et
+//les secteurs modifies ne sont ecrits qu une fois, au commit
+int _meta_begin();
+int _meta_commit();
+void _meta_abort();
+char* _tx_stage(int sector, int load);
+int _meta_patch(int sector, int offset, const void* data, int len);
+//copie en memoire du superbloc, NULL en cas d erreur
+superblock_t* _superbloc();
+int _meta_end(int write);
+int _tx_write_back(int sector);
 
 
 
@@ -124,7 +321,23 @@ int _setinodeByNumber(const int num, inode_bloc_t* ptr);
 // Fonction reserver et prendre un inode/bloc libre
 int _find_take_free_inode();
 int _find_take_free_databloc();
-int _findfreeFromMap(char * map)  ;
+//reservation de count blocs consecutifs, retourne le premier ou -1
+int _find_take_free_run(int count);
+int _findfreeFromMap(char * map, int limit)  ;
+int _find_free_run(char* map, int start, int count, int limit);
+//mode journal: allocation des blocs de donnees a la suite
+int _log_head();
+int _set_log_head(int next);
+int _free_databloc(int index);
+//partage des blocs de donnees
+int _bloc_shares(int db);
+int _set_bloc_shares(int db, int shares);
+int _share_bloc(int db);
+int _copy_bloc(int from, int to);
+int _unshare_bloc(inode_bloc_t* inode_ptr, int b);
+int _copy_range(const inode_bloc_t* src, int srcOffset, inode_bloc_t* dst, int dstOffset, int len);
+int _map_pins(int inodeIndex, int fromBloc);
+int _free_inode(int ide);
 // fonction utiles pour la lecture de bits sur  les maps
 int _setpos(char * map, int pos, int val) ;
 int _readpos(char * map, int pos) ;
@@ -136,6 +349,8 @@ int _readbit(char c, int pos) ;
 
 //Groupe de fonctions pour la gestion des table
 int _init_open_file_table();
+int _grow_open_file_table();
+void _release_descriptor(int fd);
 
 
 /**
@@ -143,14 +358,256 @@ int _init_open_file_table();
 * SECTION DES FONCTIONS UTILITAIRES
 *
 **/
+
+//secteurs de la transaction en cours: copie en memoire, NULL si le secteur n y est pas
+static char* _tx_sectors [NUM_SECTORS];
+static char _tx_dirty [NUM_SECTORS];
+//liste des secteurs de la transaction, dans l ordre ou ils ont ete touches
+static int _tx_list [NUM_SECTORS];
+static int _tx_count = 0;
+static int _tx_active = 0;
+//morceaux de TX_CHUNK octets de la copie qui sont a jour: un secteur modifie par
+// _meta_patch sans avoir ete lu n a que les morceaux ecrits
+#define TX_CHUNK (SECTOR_SIZE / 8)
+#define TX_ALL_CHUNKS 0xFF
+static unsigned char _tx_valid [NUM_SECTORS];
+
+//le superbloc est lu une fois par image; _meta_end l invalide si une transaction
+// qui l a modifie est annulee
+static superblock_t _sbloc;
+static int _sbloc_valid = 0;
+
+//ajout du secteur a la transaction, avec son contenu si load
+char* _tx_stage(int sector, int load)
+{
+    if(sector < 0 || sector >= NUM_SECTORS)
+    {
+        osErrno = E_GENERAL;
+        return NULL;
+    }
+    if(_tx_sectors[sector] == NULL)
+    {
+        char* copy = malloc(SECTOR_SIZE);
+        if(copy == NULL)
+        {
+            osErrno = E_GENERAL;
+            return NULL;
+        }
+        if(load && Cache_Read(sector, copy) == -1)
+        {
+            free(copy);
+            osErrno = E_GENERAL;
+            return NULL;
+        }
+        _tx_sectors[sector] = copy;
+        _tx_dirty[sector] = 0;
+        _tx_valid[sector] = load ? TX_ALL_CHUNKS : 0;
+        _tx_list[_tx_count++] = sector;
+    }
+    else if(load && _tx_valid[sector] != TX_ALL_CHUNKS)
+    {
+        //secteur modifie par morceaux: le reste vient du cache
+        Sector current;
+        if(Cache_Read(sector, (char*) &current) == -1)
+        {
+            osErrno = E_GENERAL;
+            return NULL;
+        }
+        for(int c = 0; c < SECTOR_SIZE / TX_CHUNK; c++)
+        {
+            if(!(_tx_valid[sector] & (1 << c)))
+            {
+                memcpy(_tx_sectors[sector] + c * TX_CHUNK, (char*) &current + c * TX_CHUNK, TX_CHUNK);
+            }
+        }
+        _tx_valid[sector] = TX_ALL_CHUNKS;
+    }
+    return _tx_sectors[sector];
+}
+
+int _meta_read(int sector, char* buffer)
+{
+    if(!_tx_active)
+    {
+        return Cache_Read(sector, buffer);
+    }
+    char* copy = _tx_stage(sector, 1);
+    if(copy == NULL)
+    {
+        return -1;
+    }
+    memcpy(buffer, copy, SECTOR_SIZE);
+    return 0;
+}
+
+int _meta_write(int sector, char* buffer)
+{
+    if(!_tx_active)
+    {
+        return Cache_Write(sector, buffer);
+    }
+    //le secteur est ecrit en entier, inutile de le lire
+    char* copy = _tx_stage(sector, 0);
+    if(copy == NULL)
+    {
+        return -1;
+    }
+    memcpy(copy, buffer, SECTOR_SIZE);
+    _tx_dirty[sector] = 1;
+    _tx_valid[sector] = TX_ALL_CHUNKS;
+    return 0;
+}
+
+/*
+ * Ecriture de len octets a offset dans le secteur sans le lire: dans une
+ * transaction seuls les morceaux ecrits sont gardes et completes au commit,
+ * sinon ils sont copies directement dans le tampon du cache
+ */
+int _meta_patch(int sector, int offset, const void* data, int len)
+{
+    if(!_tx_active)
+    {
+        char* cached = Cache_Get(sector, 1);
+        if(cached == NULL)
+        {
+            osErrno = E_GENERAL;
+            return -1;
+        }
+        memcpy(cached + offset, data, len);
+        Cache_Release(cached, 1);
+        return 0;
+    }
+    //un morceau ecrit en partie doit etre lu avant
+    int aligned = offset % TX_CHUNK == 0 && len % TX_CHUNK == 0;
+    char* copy = _tx_stage(sector, !aligned);
+    if(copy == NULL)
+    {
+        return -1;
+    }
+    memcpy(copy + offset, data, len);
+    _tx_dirty[sector] = 1;
+    for(int c = offset / TX_CHUNK; c < (offset + len) / TX_CHUNK; c++)
+    {
+        _tx_valid[sector] |= 1 << c;
+    }
+    return 0;
+}
+
+superblock_t* _superbloc()
+{
+    if(!_sbloc_valid)
+    {
+        if(_meta_read(0, (char*) &_sbloc) == -1)
+        {
+            return NULL;
+        }
+        _sbloc_valid = 1;
+    }
+    return &_sbloc;
+}
+
+int _meta_begin()
+{
+    if(_tx_active)
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    _tx_active = 1;
+    _tx_count = 0;
+    return 0;
+}
+
+//ecriture dans le cache d un secteur de la transaction, en entier ou par morceaux
+int _tx_write_back(int sector)
+{
+    if(_tx_valid[sector] == TX_ALL_CHUNKS)
+    {
+        return Cache_Write(sector, _tx_sectors[sector]);
+    }
+    char* cached = Cache_Get(sector, 1);
+    if(cached == NULL)
+    {
+        return -1;
+    }
+    for(int c = 0; c < SECTOR_SIZE / TX_CHUNK; c++)
+    {
+        if(_tx_valid[sector] & (1 << c))
+        {
+            memcpy(cached + c * TX_CHUNK, _tx_sectors[sector] + c * TX_CHUNK, TX_CHUNK);
+        }
+    }
+    Cache_Release(cached, 1);
+    return 0;
+}
+
+//fin de la transaction; write indique s il faut ecrire les secteurs modifies
+int _meta_end(int write)
+{
+    int ret = 0;
+    for(int i = 0; i < _tx_count; i++)
+    {
+        int sector = _tx_list[i];
+        if(write && _tx_dirty[sector] && _tx_write_back(sector) == -1)
+        {
+            osErrno = E_GENERAL;
+            ret = -1;
+            write = 0;
+        }
+        //les inodes en memoire et le superbloc ont vu les modifications qui ne sont pas ecrites
+        if(!write && _tx_dirty[sector])
+        {
+            _incore_invalidate_sector(sector);
+            if(sector == 0)
+            {
+                _sbloc_valid = 0;
+            }
+        }
+        free(_tx_sectors[sector]);
+        _tx_sectors[sector] = NULL;
+        _tx_dirty[sector] = 0;
+    }
+    _tx_count = 0;
+    _tx_active = 0;
+    return ret;
+}
+
+int _meta_commit()
+{
+    return _meta_end(1);
+}
+
+void _meta_abort()
+{
+    _meta_end(0);
+}
 //
 int _init_open_file_table(){
     if(_is_open_filetable_init) return 0;
-    memset( _open_file_table, 0,sizeof(descriptor_entry_t)*MAX_OPEN_FILES);
+    if(_grow_open_file_table() == -1) return -1;
     _is_open_filetable_init = 1;
     return 0;
 }
 
+//la table double de taille; les nouvelles entrees sont mises en tete de la liste libre
+int _grow_open_file_table(){
+    int capacity = _open_file_capacity == 0 ? OPEN_FILES_INITIAL : 2 * _open_file_capacity;
+    if(capacity > MAX_OPEN_FILES) return -1;
+    descriptor_entry_t* table = realloc(_open_file_table, capacity * sizeof(descriptor_entry_t));
+    if(table == NULL) return -1;
+    memset(table + _open_file_capacity, 0, (capacity - _open_file_capacity) * sizeof(descriptor_entry_t));
+    //chainage dans l ordre croissant: les plus petits descripteurs sortent d abord
+    for(int fd = capacity - 1; fd >= _open_file_capacity; fd--)
+    {
+        table[fd].inode_index = -1;
+        table[fd].next_free = _free_descriptor;
+        _free_descriptor = fd;
+    }
+    _open_file_table = table;
+    _open_file_capacity = capacity;
+    return 0;
+}
+
 
 //***
 int formatDisc() {
@@ -159,17 +616,18 @@ inode_bitmap_t inodemap ;
 databloc_bitmap_t dbmap;
 memset(&sbloc, 0, sizeof(superblock_t));
 sbloc.magicnumber = MAGICNUMBER ;
+sbloc.version = FS_VERSION ;
 memset(&inodemap, 0, sizeof(inode_bitmap_t));
 //create a root inode
 inodemap.map[0] = 0x01;
 //
 memset(&dbmap, 0, sizeof(inode_bitmap_t));
 //
-Disk_Write(0,(char*)&sbloc);
-Disk_Write(1,(char*)&(inodemap.map));
-Disk_Write(2,(char*)&(inodemap.map)+sizeof(Sector));
-Disk_Write(3,(char*)&(dbmap.map));
-Disk_Write(4,(char*)&(dbmap.map)+sizeof(Sector));
+Cache_Write(0,(char*)&sbloc);
+Cache_Write(1,(char*)&(inodemap.map));
+Cache_Write(2,(char*)&(inodemap.map)+sizeof(Sector));
+Cache_Write(3,(char*)&(dbmap.map));
+Cache_Write(4,(char*)&(dbmap.map)+sizeof(Sector));
 //inode table start here
 // L inode 0 est reservee pour la racine
 _create_root_inode();
@@ -189,9 +647,10 @@ inode_bloc_t* inode = (inode_bloc_t*) &sector; //  inodes pour faire un secteur
 //remplir les champs pour l inode 0 celle de la racine
 inode->type = DIRECTORY_TYPE ;
 inode->size = 0; // le repertoire est vide
+memset(inode->pointers,-1,DATA_BLOCK_PER_INODE*sizeof(int)); // aucun seau alloue
 //copie du tableau d'inodes dans le secteur des inodes
 // ne pas oublier de mettre toujours le decalage pour avoir le bon secteur sur le disque
-if( Disk_Write(INODE_OFFSET+0, (char*) & sector) == -1 )
+if( Cache_Write(INODE_OFFSET+0, (char*) & sector) == -1 )
 {
     osErrno = E_ROOT_DIR;
     return -1;
@@ -221,6 +680,13 @@ int _path_2_inode_number(const char* path)
             return 0;
         }
 
+        //un chemin deja resolu ne coute qu une recherche dans le cache
+        int cached_inode = -1;
+        if(Dentry_LookupPath(path, &cached_inode))
+        {
+            return cached_inode;
+        }
+
         //copie du path car la fonction strtok modifie son parametre
         char* actual_path_cpy = (char*) alloca(strlen(path)+1);
         strcpy(actual_path_cpy,path);//utilisation de strcpy
@@ -230,8 +696,7 @@ int _path_2_inode_number(const char* path)
         int current_inode = 0;
         for (char *token = strtok(actual_path_cpy,"/"); token != NULL; token = strtok(NULL, "/"))
         {
-            //demande pour avoir l index de cette entree sur le repertoire courant de recherche
-            current_inode = _lookup_directory_entry(current_inode,token);
+            current_inode = _lookup_component(current_inode, token);
             if(current_inode == -1)
             {//aie on ne trouve le token dans le repertoire courant alors le chemin est invalide
                 osErrno =  E_NO_SUCH_FILE;
@@ -239,6 +704,7 @@ int _path_2_inode_number(const char* path)
             }
         }
         //bingo j ai trouve ici inode du dernier token sur le path je le retourne
+        Dentry_InsertPath(path, current_inode);
         return current_inode;
     }
 
@@ -248,8 +714,37 @@ int _path_2_inode_number(const char* path)
 
 
 
+/*
+ * Un composant de chemin: le cache (parent, nom) evite de relire le repertoire
+ */
+int _lookup_component(int dirIndex, const char* name)
+{
+    int index = -1;
+    if(Dentry_Lookup(dirIndex, name, &index))
+    {
+        return index;
+    }
+    //demande pour avoir l index de cette entree sur le repertoire; une erreur de
+    //lecture (E_GENERAL) n est pas une absence et n est pas gardee
+    index = _lookup_directory_entry(dirIndex, name);
+    if(index != -1 || osErrno == E_NO_SUCH_FILE)
+    {
+        Dentry_Insert(dirIndex, name, index);
+    }
+    return index;
+}
+
+//nom d entree utilisable: non vide, assez court et sans separateur
+int _valid_entry_name(const char* name)
+{
+    return name != NULL && name[0] != '\0' &&
+           strlen(name) < MAX_NAME_SIZE && strchr(name, '/') == NULL;
+}
+
 /*
  * Fonction qui cherche une entree a partir de l index du repertoire
+ * retourne -1 avec E_NO_SUCH_FILE si le nom n y est pas, avec E_GENERAL si un
+ * bloc ou l inode n a pas pu etre lu
  */
 int _lookup_directory_entry(const int inodeNum, const char* entryName)
 {
@@ -257,11 +752,11 @@ int _lookup_directory_entry(const int inodeNum, const char* entryName)
 inode_bloc_t inode;
 if( _getinodeByNumber( inodeNum , &inode ) == -1)
 {
-    osErrno = E_NO_SUCH_FILE;
+    osErrno = E_GENERAL;
     return -1;
 }
 //verification qu il s agit bien d une entree repertoire et qu il n est pas vide
-if( inode.type != DIRECTORY_TYPE )
+if( !_is_directory(inode.type) )
 {
     osErrno = E_GENERAL;
     return -1;
@@ -274,143 +769,1280 @@ osErrno = E_NO_SUCH_FILE;
 return -1;
 }
 
-//lecture du contenu du repertoire pour cherche le nom
-//allocation de la memoire pour recevoir localement tout le contenu
-char* data = alloca(inode.size);
-/*solution simple: copier tout le contenu pour travailler localement*/
-if( _copy_file_content(data,&inode) == -1) //
-{
-    osErrno = E_GENERAL;
-    return -1;
+//le hachage du nom donne le seau: on ne lit qu un bloc (deux en cas de debordement)
+//une lecture qui echoue remplace E_NO_SUCH_FILE par E_GENERAL
+osErrno = E_NO_SUCH_FILE;
+return _dir_lookup(&inode, entryName);
 }
-//nous avons maintenant une copie locale du contenu
 
-// nous allons cherche l entree souhaitee
-directory_entry_t* dirContent = (directory_entry_t*) data;
-//calcule du nombre d entrees a partir de la taille
-int numberOfEntries = (inode.size/sizeof(directory_entry_t))+1;
-//iteration sur les entrees du repertoire pour trouver le token demande
-for(int i = 0 ; i < numberOfEntries; i++)
+
+/*
+ * Hachage FNV-1a du nom (au plus MAX_NAME_SIZE caracteres)
+ */
+unsigned int _name_hash(const char* name)
 {
-    if( strcmp(dirContent[i].name,entryName) == 0 )
+    unsigned int hash = 2166136261u;
+    for(int i = 0; i < MAX_NAME_SIZE && name[i] != '\0'; i++)
     {
-        //nous avons trouve l entree, on retourne son index
-        return dirContent[i].index;
-    };
-}
-//si je suis ici c est que le token n existe pas dans le repertoire
-osErrno = E_NO_SUCH_FILE;
-return -1;
+        hash ^= (byte) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
 }
 
-
-
-
-// Fonction elementaire pour liberer un bloc donnee
-int _free_databloc(int index)
+//nombre de seaux du repertoire: les pointeurs sont alloues de facon contigue
+int _dir_bucket_count(const inode_bloc_t* dir)
 {
-    databloc_bitmap_t dbmap;
-    _loadDBMap((char*)&dbmap.map);
-    _setpos((char*)&dbmap.map, index, 0 );
-    _writeDBMap((char*)&dbmap.map);
-    return 0;
-};
+    int n = 0;
+    while(n < DATA_BLOCK_PER_INODE && dir->pointers[n] != -1)
+    {
+        n++;
+    }
+    return n;
+}
 
-//fonction elementaire pour avoir un nouveau bloc donnees
-int _allocate_new_databloc()
+/*
+ * Seau d un hash pour un repertoire de nbBuckets seaux (hachage lineaire)
+ * level est la plus grande puissance de 2 <= nbBuckets, les seaux
+ * [0, nbBuckets - level) ont deja ete eclates vers [level, nbBuckets)
+ */
+int _dir_bucket_of(unsigned int hash, int nbBuckets)
 {
- return _find_take_free_databloc();
-};
-
-
-
-/*copie tout le contenu du fichier dans ptr*/
+    unsigned int level = 1;
+    while(level*2 <= (unsigned int) nbBuckets)
+    {
+        level *= 2;
+    }
+    unsigned int bucket = hash % (2*level);
+    if(bucket >= (unsigned int) nbBuckets)
+    {
+        bucket = hash % level;
+    }
+    return (int) bucket;
+}
 
-int _copy_file_content(void* ptr, const inode_bloc_t* inode_ptr)
+int _read_dir_bloc(int dbIndex, directory_bloc_t* bloc)
 {
-    //ici simple utilisation de la fonction existante
-    int toRead = inode_ptr->size;
-    _read_file_content(ptr,0,toRead,inode_ptr);
+    if( _meta_read(DB_OFFSET+dbIndex, (char*) bloc) == -1 )
+    {
+        perror("Disk_Read() failed\n");
+        osErrno = E_GENERAL;
+        return -1;
+    }
     return 0;
-};
-
-
+}
 
-int _getinodeByNumber(const int num, inode_bloc_t* ptr)
+int _write_dir_bloc(int dbIndex, directory_bloc_t* bloc)
 {
-    //calcule simple pour transformer les coordonnees correctement
-  int ind = num / 4;  //indice du bloc
-  int p = num % 4;    // indice interne
-  inode_bloc_t sect_in[4]; //bloc complet d'inodes
-  //lecture a partir de l offset des inodes
-  if  (Disk_Read(INODE_OFFSET+ind, (char *) sect_in)  == -1 ) {
-    perror("Disk_Read() failed\n");
-    osErrno = E_GENERAL;
-    return -1;
+    if( _meta_write(DB_OFFSET+dbIndex, (char*) bloc) == -1 )
+    {
+        perror("Disk_Write() failed\n");
+        osErrno = E_GENERAL;
+        return -1;
     }
-  //copie du resultat car nous avons recupere trop d informations
-  memcpy(ptr,sect_in+p,sizeof(inode_bloc_t));
-  return 0;
-};
+    return 0;
+}
 
-int _setinodeByNumber(const int num, inode_bloc_t* ptr)
+/*
+ * Recherche du nom dans son seau, puis dans les seaux suivants si le seau a deborde
+ * bloc recoit le bloc qui contient l entree, bucketPtr et slotPtr sa position
+ * retourne l index de l inode de l entree ou -1
+ */
+int _dir_find_slot(const inode_bloc_t* dir, const char* name, directory_bloc_t* bloc, int* bucketPtr, int* slotPtr)
 {
-  int ind = num / 4;  //indice du bloc
-  int p = num % 4;    // indice interne
-  inode_bloc_t sect_inout[4]; //bloc complet d'inodes
-  //lecture des anciennes valeurs
-  //c est important car il ne faut pas ecraser les valeurs des inodes voisins
-  if  (Disk_Read(INODE_OFFSET+ind, (char *) sect_inout)  == -1 ) {
-    perror("Disk_Read() failed\n");
-    osErrno = E_GENERAL;
-    return -1;
+    int nbBuckets = _dir_bucket_count(dir);
+    if(nbBuckets == 0)
+    {
+        return -1;
     }
-  //copie des donnes uniquement dans l inode qui nous interesse et ne pas toucher aux autres
-  memcpy(sect_inout+p,ptr,sizeof(inode_bloc_t));
-
-    //ecriture de l ensemble maintenant sur le disque
-  if  (Disk_Write(INODE_OFFSET+ind, (char *) sect_inout)  == -1 ) {
-    perror("Disk_Write() failed\n");
-    osErrno = E_GENERAL;
+    //les noms sont ranges completes par des 0: une comparaison de 16 octets par entree
+    char key[MAX_NAME_SIZE];
+    DirSearch_MakeKey(key, name);
+    int first = _dir_bucket_of(_name_hash(name), nbBuckets);
+    int bucket = first;
+    do
+    {
+        if( _read_dir_bloc(dir->pointers[bucket], bloc) == -1)
+        {
+            return -1;
+        }
+        int i = DirSearch_Block(bloc->entries, DIR_ENTRIES_PER_BLOC, key);
+        if( i != -1 )
+        {
+            if(bucketPtr != NULL) {*bucketPtr = bucket;}
+            if(slotPtr != NULL) {*slotPtr = i;}
+            return bloc->entries[i].index;
+        }
+        //pas de debordement: le nom ne peut pas etre plus loin
+        if( !bloc->overflow )
+        {
+            break;
+        }
+        bucket = (bucket + 1) % nbBuckets;
+    } while(bucket != first);
     return -1;
-    }
-// tout est ok
-  return 0;
-};
-
+}
 
-//fonction pour formatee le disque
-int _createAndFormatNewDisc()
+//premier emplacement libre d un seau ou -1, lu directement dans la carte
+int _dir_free_slot(const directory_bloc_t* bloc)
 {
-    if( formatDisc() == -1)
+    int freeMap = ~bloc->used_map & DIR_SLOTS_MASK;
+    if(freeMap == 0)
     {
-        perror("Error on format disc");
         return -1;
-    } ;
-    return 0;
+    }
+    return __builtin_ctz(freeMap);
 }
 
-
-
-//fonction utile pour trouver le repertoire contenant dans un chemin
-int _copy_trim_last_token(char* destPath, const char* srcPath)
+/*
+ * Ajout d un seau a la fin du repertoire en eclatant le seau (nbBuckets - level)
+ * seules les entrees qui changent de seau sont deplacees
+ */
+int _dir_split_bucket(inode_bloc_t* dir)
 {
-    if(srcPath[0] != '/')
+    int nbBuckets = _dir_bucket_count(dir);
+    if(nbBuckets >= DATA_BLOCK_PER_INODE)
     {
-        perror("Absolute path required");
         return -1;
     }
-    strcpy(destPath,srcPath);
-    int i = strlen(destPath);
-    for(; (destPath[i] != '/') && (i >=0) ; i--)
+    int indexDB = _find_take_free_databloc();
+    if(indexDB == -1)
     {
-        //
+        perror("No free databloc");
+        osErrno = E_NO_SPACE;
+        return -1;
     }
-    if(i == 0) // cas de la racine
+    dir->pointers[nbBuckets] = indexDB;
+
+    directory_bloc_t newBloc;
+    memset(&newBloc, 0, sizeof(directory_bloc_t));
+    if(nbBuckets == 0)
     {
-        destPath[i+1] = '\0';
-        return 0;
-    }else
+        //premier seau du repertoire, rien a eclater
+        return _write_dir_bloc(indexDB, &newBloc);
+    }
+
+    int level = 1;
+    while(level*2 <= nbBuckets)
+    {
+        level *= 2;
+    }
+    int victim = nbBuckets - level;
+    directory_bloc_t oldBloc;
+    if( _read_dir_bloc(dir->pointers[victim], &oldBloc) == -1)
+    {
+        return -1;
+    }
+    //le nouveau seau s insere entre le dernier seau et le seau 0: si le dernier a
+    // deborde, les chaines de sondage passent aussi par le nouveau
+    if(victim == nbBuckets-1)
+    {
+        newBloc.overflow = oldBloc.overflow;
+    }
+    else
+    {
+        directory_bloc_t lastBloc;
+        if( _read_dir_bloc(dir->pointers[nbBuckets-1], &lastBloc) == -1)
+        {
+            return -1;
+        }
+        newBloc.overflow = lastBloc.overflow;
+    }
+    if(oldBloc.overflow)
+    {
+        //des entrees du seau sont dans les seaux suivants: tout l index est replace
+        // sur nbBuckets+1 seaux, ce qui remet aussi a jour les drapeaux de debordement
+        if( _write_dir_bloc(indexDB, &newBloc) == -1 )
+        {
+            return -1;
+        }
+        return _dir_rebuild(dir, nbBuckets+1) == 1 ? 0 : -1;
+    }
+    int j = 0;
+    for(int i = 0; i < DIR_ENTRIES_PER_BLOC; i++)
+    {
+        if( (oldBloc.used_map & (1 << i)) &&
+            _dir_bucket_of(_name_hash(oldBloc.entries[i].name), nbBuckets+1) == nbBuckets )
+        {
+            newBloc.entries[j] = oldBloc.entries[i];
+            newBloc.used_map |= 1 << j;
+            j++;
+            memset(&oldBloc.entries[i], 0, sizeof(directory_entry_t));
+            oldBloc.entries[i].index = -1;
+            oldBloc.used_map &= ~(1 << i);
+        }
+    }
+    if( _write_dir_bloc(dir->pointers[victim], &oldBloc) == -1 || _write_dir_bloc(indexDB, &newBloc) == -1 )
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Insertion d une entree dans l index hache du repertoire
+ * le seau plein est eclate tant que le repertoire peut grandir,
+ * ensuite on deborde sur les seaux suivants (sondage lineaire)
+ */
+int _dir_insert_entry(inode_bloc_t* dir, const char* name, int childIndex)
+{
+    if(dir->type == ORDERED_DIRECTORY_TYPE)
+    {
+        return _btree_insert(dir, name, childIndex);
+    }
+    directory_bloc_t bloc;
+    unsigned int hash = _name_hash(name);
+    if( _dir_bucket_count(dir) == 0 && _dir_split_bucket(dir) == -1 )
+    {
+        return -1;
+    }
+    for(;;)
+    {
+        int nbBuckets = _dir_bucket_count(dir);
+        int bucket = _dir_bucket_of(hash, nbBuckets);
+        if( _read_dir_bloc(dir->pointers[bucket], &bloc) == -1)
+        {
+            return -1;
+        }
+        int slot = _dir_free_slot(&bloc);
+        if( slot == -1 && nbBuckets < DATA_BLOCK_PER_INODE )
+        {
+            //seau plein: le repertoire grandit d un seau et on recommence
+            if( _dir_split_bucket(dir) == -1 )
+            {
+                return -1;
+            }
+            continue;
+        }
+        //plus de seau possible: on deborde sur les seaux suivants
+        int first = bucket;
+        while( slot == -1 )
+        {
+            bloc.overflow = 1;
+            if( _write_dir_bloc(dir->pointers[bucket], &bloc) == -1)
+            {
+                return -1;
+            }
+            bucket = (bucket + 1) % nbBuckets;
+            if(bucket == first)
+            {
+                perror("Max size for a directory is reached");
+                osErrno = E_NO_SPACE;
+                return -1;
+            }
+            if( _read_dir_bloc(dir->pointers[bucket], &bloc) == -1)
+            {
+                return -1;
+            }
+            slot = _dir_free_slot(&bloc);
+        }
+        memset(&bloc.entries[slot], 0, sizeof(directory_entry_t));
+        strncpy(bloc.entries[slot].name, name, MAX_NAME_SIZE-1);
+        bloc.entries[slot].index = childIndex;
+        bloc.used_map |= 1 << slot;
+        if( _write_dir_bloc(dir->pointers[bucket], &bloc) == -1)
+        {
+            return -1;
+        }
+        dir->size = dir->size + sizeof(directory_entry_t);
+        return 0;
+    }
+}
+
+/*
+ * 1 si une entree du seau bucket est rangee dans un des seaux suivants, 0 si
+ * son drapeau de debordement ne sert plus, -1 en cas d erreur
+ */
+int _dir_overflow_used(const inode_bloc_t* dir, int bucket)
+{
+    int nbBuckets = _dir_bucket_count(dir);
+    directory_bloc_t bloc;
+    for(int b = (bucket + 1) % nbBuckets; b != bucket; b = (b + 1) % nbBuckets)
+    {
+        if( _read_dir_bloc(dir->pointers[b], &bloc) == -1)
+        {
+            return -1;
+        }
+        for(int i = 0; i < DIR_ENTRIES_PER_BLOC; i++)
+        {
+            if( (bloc.used_map & (1 << i)) && _dir_bucket_of(_name_hash(bloc.entries[i].name), nbBuckets) == bucket )
+            {
+                return 1;
+            }
+        }
+        //la chaine de sondage s arrete au premier seau qui n a pas deborde
+        if( !bloc.overflow )
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Fusion du dernier seau dans le seau qu il a eclate (inverse de _dir_split_bucket)
+ * le bloc libere retourne dans la carte des blocs
+ * retourne 1 si fusionne, 0 si la fusion n est pas possible, -1 en cas d erreur
+ */
+int _dir_merge_last_bucket(inode_bloc_t* dir)
+{
+    int nbBuckets = _dir_bucket_count(dir);
+    if(nbBuckets <= 1)
+    {
+        return 0;
+    }
+    int level = 1;
+    while(level*2 <= nbBuckets-1)
+    {
+        level *= 2;
+    }
+    int buddy = nbBuckets - 1 - level;
+
+    directory_bloc_t lastBloc;
+    directory_bloc_t buddyBloc;
+    if( _read_dir_bloc(dir->pointers[nbBuckets-1], &lastBloc) == -1 ||
+        _read_dir_bloc(dir->pointers[buddy], &buddyBloc) == -1 )
+    {
+        return -1;
+    }
+    if( __builtin_popcount(lastBloc.used_map) > __builtin_popcount(~buddyBloc.used_map & DIR_SLOTS_MASK) )
+    {
+        return 0;
+    }
+    //un seau qui a deborde a des entrees ailleurs, on ne le fusionne pas; le drapeau
+    // reste pose apres la suppression de ces entrees, il est alors remis a 0
+    if( lastBloc.overflow )
+    {
+        int displaced = _dir_overflow_used(dir, nbBuckets-1);
+        if( displaced == -1 )
+        {
+            return -1;
+        }
+        if( displaced == 1 )
+        {
+            return 0;
+        }
+        lastBloc.overflow = 0;
+    }
+    for(int i = 0; i < DIR_ENTRIES_PER_BLOC; i++)
+    {
+        if(lastBloc.used_map & (1 << i))
+        {
+            //une entree venue d un autre seau par debordement resterait introuvable
+            if( _dir_bucket_of(_name_hash(lastBloc.entries[i].name), nbBuckets) != nbBuckets-1 )
+            {
+                return 0;
+            }
+        }
+    }
+    for(int i = 0; i < DIR_ENTRIES_PER_BLOC; i++)
+    {
+        if(lastBloc.used_map & (1 << i))
+        {
+            int slot = _dir_free_slot(&buddyBloc);
+            buddyBloc.entries[slot] = lastBloc.entries[i];
+            buddyBloc.used_map |= 1 << slot;
+        }
+    }
+    if( _write_dir_bloc(dir->pointers[buddy], &buddyBloc) == -1 ||
+        _free_databloc(dir->pointers[nbBuckets-1]) == -1 )
+    {
+        return -1;
+    }
+    dir->pointers[nbBuckets-1] = -1;
+    return 1;
+}
+
+/*
+ * Reconstruction complete de l index sur target seaux, les seaux en trop sont liberes
+ * utilisee pour eclater un seau qui a deborde: chaque entree est replacee depuis
+ * son seau et les drapeaux de debordement sont recalcules
+ */
+int _dir_rebuild(inode_bloc_t* dir, int target)
+{
+    int nbBuckets = _dir_bucket_count(dir);
+    if(target < 1 || target > nbBuckets)
+    {
+        return 0;
+    }
+    //lecture de toutes les entrees
+    directory_entry_t* entries = alloca(nbBuckets * DIR_ENTRIES_PER_BLOC * sizeof(directory_entry_t));
+    int nbEntries = 0;
+    for(int b = 0; b < nbBuckets; b++)
+    {
+        directory_bloc_t bloc;
+        if( _read_dir_bloc(dir->pointers[b], &bloc) == -1)
+        {
+            return -1;
+        }
+        for(int i = 0; i < DIR_ENTRIES_PER_BLOC; i++)
+        {
+            if(bloc.used_map & (1 << i))
+            {
+                entries[nbEntries++] = bloc.entries[i];
+            }
+        }
+    }
+    if(nbEntries > target * DIR_ENTRIES_PER_BLOC)
+    {
+        return 0;
+    }
+    //placement en memoire dans les target premiers seaux
+    directory_bloc_t* blocs = alloca(target * sizeof(directory_bloc_t));
+    memset(blocs, 0, target * sizeof(directory_bloc_t));
+    for(int e = 0; e < nbEntries; e++)
+    {
+        int bucket = _dir_bucket_of(_name_hash(entries[e].name), target);
+        int slot = _dir_free_slot(&blocs[bucket]);
+        while(slot == -1)
+        {
+            blocs[bucket].overflow = 1;
+            bucket = (bucket + 1) % target;
+            slot = _dir_free_slot(&blocs[bucket]);
+        }
+        blocs[bucket].entries[slot] = entries[e];
+        blocs[bucket].used_map |= 1 << slot;
+    }
+    for(int b = 0; b < target; b++)
+    {
+        if( _write_dir_bloc(dir->pointers[b], &blocs[b]) == -1)
+        {
+            return -1;
+        }
+    }
+    for(int b = target; b < nbBuckets; b++)
+    {
+        _free_databloc(dir->pointers[b]);
+        dir->pointers[b] = -1;
+    }
+    return 1;
+}
+
+/*
+ * Suppression d une entree de l index hache, retourne l index de son inode
+ * l inode du repertoire est modifiee (taille), a l appelant de la sauvegarder
+ * quand le repertoire est peu rempli, les derniers seaux sont fusionnes et liberes
+ */
+int _dir_remove_entry(inode_bloc_t* dir, const char* name)
+{
+    if(dir->type == ORDERED_DIRECTORY_TYPE)
+    {
+        return _btree_remove(dir, name);
+    }
+    directory_bloc_t bloc;
+    int bucket = -1;
+    int slot = -1;
+    int index = _dir_find_slot(dir, name, &bloc, &bucket, &slot);
+    if(index == -1)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    memset(&bloc.entries[slot], 0, sizeof(directory_entry_t));
+    bloc.entries[slot].index = -1;
+    bloc.used_map &= ~(1 << slot);
+    if( _write_dir_bloc(dir->pointers[bucket], &bloc) == -1)
+    {
+        return -1;
+    }
+    dir->size = dir->size - sizeof(directory_entry_t);
+
+    //compaction: tant que les entrees tiennent dans un seau de moins rempli a moitie
+    int nbEntries = dir->size / sizeof(directory_entry_t);
+    int nbBuckets = _dir_bucket_count(dir);
+    while( nbBuckets > 1 && nbEntries * DIR_COMPACT_FILL <= (nbBuckets-1) * DIR_ENTRIES_PER_BLOC )
+    {
+        //fusion impossible (seau trop plein, debordement): l index reste tel quel,
+        // une autre suppression reessaiera
+        int merged = _dir_merge_last_bucket(dir);
+        if(merged == -1)
+        {
+            return -1;
+        }
+        if(merged == 0)
+        {
+            break;
+        }
+        nbBuckets--;
+    }
+    return index;
+}
+
+
+
+//les deux formats de repertoire
+int _is_directory(int type)
+{
+    return type == DIRECTORY_TYPE || type == ORDERED_DIRECTORY_TYPE;
+}
+
+/*
+ * Recherche d un nom dans un repertoire, hache ou ordonne
+ * retourne l index de l inode de l entree ou -1
+ */
+int _dir_lookup(const inode_bloc_t* dir, const char* name)
+{
+    if(dir->type == ORDERED_DIRECTORY_TYPE)
+    {
+        return _btree_lookup(dir, name);
+    }
+    directory_bloc_t bloc;
+    return _dir_find_slot(dir, name, &bloc, NULL, NULL);
+}
+
+int _read_btree_node(int dbIndex, btree_node_t* node)
+{
+    return _read_dir_bloc(dbIndex, (directory_bloc_t*) node);
+}
+
+int _write_btree_node(int dbIndex, btree_node_t* node)
+{
+    return _write_dir_bloc(dbIndex, (directory_bloc_t*) node);
+}
+
+//fils d un noeud interne qui couvre key: le dernier dont la cle est <= key (0 sinon)
+int _btree_child_of(const btree_node_t* node, const char* key)
+{
+    int low = 1;
+    int high = node->count - 1;
+    int child = 0;
+    while(low <= high)
+    {
+        int mid = (low + high) / 2;
+        if( strncmp(node->entries[mid].name, key, MAX_NAME_SIZE) <= 0 )
+        {
+            child = mid;
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+    return child;
+}
+
+/*
+ * Descente de la racine jusqu a la feuille qui couvre key
+ * path et childPos (optionnels) recoivent les noeuds internes traverses et le fils suivi
+ * retourne le bloc de la feuille, -1 si l arbre est vide
+ */
+int _btree_find_leaf(const inode_bloc_t* dir, const char* key, btree_node_t* leaf, int* path, int* childPos, int* depthPtr)
+{
+    int block = dir->pointers[0];
+    int depth = 0;
+    if(block == -1)
+    {
+        return -1;
+    }
+    if( _read_btree_node(block, leaf) == -1)
+    {
+        return -1;
+    }
+    while(!leaf->leaf)
+    {
+        if(depth >= BTREE_MAX_DEPTH)
+        {
+            osErrno = E_GENERAL;
+            return -1;
+        }
+        int child = key == NULL ? 0 : _btree_child_of(leaf, key);
+        if(path != NULL) {path[depth] = block;}
+        if(childPos != NULL) {childPos[depth] = child;}
+        depth++;
+        block = leaf->entries[child].index;
+        if( _read_btree_node(block, leaf) == -1)
+        {
+            return -1;
+        }
+    }
+    if(depthPtr != NULL) {*depthPtr = depth;}
+    return block;
+}
+
+int _btree_lookup(const inode_bloc_t* dir, const char* name)
+{
+    btree_node_t leaf;
+    if( _btree_find_leaf(dir, name, &leaf, NULL, NULL, NULL) == -1)
+    {
+        return -1;
+    }
+    //les noms de la feuille sont completes par des 0 comme dans les seaux
+    char key[MAX_NAME_SIZE];
+    DirSearch_MakeKey(key, name);
+    int i = DirSearch_Block(leaf.entries, leaf.count, key);
+    return i == -1 ? -1 : leaf.entries[i].index;
+}
+
+/*
+ * Insertion dans l arbre B+: le noeud plein est coupe en deux et la premiere
+ * cle du nouveau noeud remonte dans le parent, jusqu a une nouvelle racine
+ */
+int _btree_insert(inode_bloc_t* dir, const char* name, int childIndex)
+{
+    directory_entry_t up;
+    memset(&up, 0, sizeof(directory_entry_t));
+    strncpy(up.name, name, MAX_NAME_SIZE-1);
+    up.index = childIndex;
+
+    btree_node_t node;
+    if(dir->pointers[0] == -1)
+    {
+        //premiere entree: la racine est une feuille
+        int root = _find_take_free_databloc();
+        if(root == -1)
+        {
+            osErrno = E_NO_SPACE;
+            return -1;
+        }
+        memset(&node, 0, sizeof(btree_node_t));
+        node.leaf = 1;
+        node.next = -1;
+        node.count = 1;
+        node.entries[0] = up;
+        if( _write_btree_node(root, &node) == -1)
+        {
+            return -1;
+        }
+        dir->pointers[0] = root;
+        dir->size = dir->size + sizeof(directory_entry_t);
+        return 0;
+    }
+
+    int path[BTREE_MAX_DEPTH];
+    int childPos[BTREE_MAX_DEPTH];
+    int depth = 0;
+    int block = _btree_find_leaf(dir, up.name, &node, path, childPos, &depth);
+    if(block == -1)
+    {
+        return -1;
+    }
+    int pos = 0;
+    while(pos < node.count && strncmp(node.entries[pos].name, up.name, MAX_NAME_SIZE) < 0)
+    {
+        pos++;
+    }
+    if(pos < node.count && strncmp(node.entries[pos].name, up.name, MAX_NAME_SIZE) == 0)
+    {
+        osErrno = E_CREATE;
+        return -1;
+    }
+
+    //blocs necessaires: un par noeud plein sur le chemin, plus une racine si tous sont pleins
+    //ils sont reserves avant toute ecriture pour ne pas laisser l arbre a moitie coupe
+    int needed = 0;
+    btree_node_t ancestor;
+    if(node.count == DIR_ENTRIES_PER_BLOC)
+    {
+        needed = 1;
+        for(int l = depth - 1; l >= 0; l--)
+        {
+            if( _read_btree_node(path[l], &ancestor) == -1)
+            {
+                return -1;
+            }
+            if(ancestor.count < DIR_ENTRIES_PER_BLOC)
+            {
+                break;
+            }
+            needed++;
+        }
+        if(needed == depth + 1)
+        {
+            needed++; //nouvelle racine
+        }
+    }
+    int reserved[BTREE_MAX_DEPTH + 2];
+    for(int r = 0; r < needed; r++)
+    {
+        reserved[r] = _find_take_free_databloc();
+        if(reserved[r] == -1)
+        {
+            for(int f = 0; f < r; f++)
+            {
+                _free_databloc(reserved[f]);
+            }
+            osErrno = E_NO_SPACE;
+            return -1;
+        }
+    }
+    int nextReserved = 0;
+
+    for(;;)
+    {
+        if(node.count < DIR_ENTRIES_PER_BLOC)
+        {
+            memmove(&node.entries[pos+1], &node.entries[pos], (node.count - pos) * sizeof(directory_entry_t));
+            node.entries[pos] = up;
+            node.count++;
+            if( _write_btree_node(block, &node) == -1)
+            {
+                return -1;
+            }
+            break;
+        }
+        //noeud plein: coupe en deux moities
+        directory_entry_t all[DIR_ENTRIES_PER_BLOC + 1];
+        memcpy(all, node.entries, pos * sizeof(directory_entry_t));
+        all[pos] = up;
+        memcpy(all + pos + 1, node.entries + pos, (node.count - pos) * sizeof(directory_entry_t));
+        int half = (DIR_ENTRIES_PER_BLOC + 1) / 2;
+
+        int rightBlock = reserved[nextReserved++];
+        btree_node_t right;
+        memset(&right, 0, sizeof(btree_node_t));
+        right.leaf = node.leaf;
+        right.count = DIR_ENTRIES_PER_BLOC + 1 - half;
+        memcpy(right.entries, all + half, right.count * sizeof(directory_entry_t));
+        memset(node.entries, 0, sizeof(node.entries));
+        node.count = half;
+        memcpy(node.entries, all, half * sizeof(directory_entry_t));
+        if(node.leaf)
+        {
+            right.next = node.next;
+            node.next = rightBlock;
+        }
+        else
+        {
+            right.next = -1;
+        }
+        if( _write_btree_node(block, &node) == -1 || _write_btree_node(rightBlock, &right) == -1)
+        {
+            return -1;
+        }
+
+        //la premiere cle du nouveau noeud remonte
+        memcpy(up.name, right.entries[0].name, MAX_NAME_SIZE);
+        up.index = rightBlock;
+        if(depth == 0)
+        {
+            //la racine a ete coupee: nouvelle racine a deux fils
+            int rootBlock = reserved[nextReserved++];
+            btree_node_t root;
+            memset(&root, 0, sizeof(btree_node_t));
+            root.leaf = 0;
+            root.next = -1;
+            root.count = 2;
+            memcpy(root.entries[0].name, node.entries[0].name, MAX_NAME_SIZE);
+            root.entries[0].index = block;
+            root.entries[1] = up;
+            if( _write_btree_node(rootBlock, &root) == -1)
+            {
+                return -1;
+            }
+            dir->pointers[0] = rootBlock;
+            break;
+        }
+        depth--;
+        block = path[depth];
+        pos = childPos[depth] + 1;
+        if( _read_btree_node(block, &node) == -1)
+        {
+            return -1;
+        }
+    }
+    dir->size = dir->size + sizeof(directory_entry_t);
+    return 0;
+}
+
+/*
+ * Suppression dans l arbre B+, retourne l index de l inode de l entree
+ * les noeuds ne sont pas re-equilibres: une feuille videe est retiree de son
+ * parent et de la liste des feuilles, et une racine a un seul fils est remplacee par lui
+ */
+int _btree_remove(inode_bloc_t* dir, const char* name)
+{
+    int path[BTREE_MAX_DEPTH];
+    int childPos[BTREE_MAX_DEPTH];
+    int depth = 0;
+    btree_node_t leaf;
+    int block = _btree_find_leaf(dir, name, &leaf, path, childPos, &depth);
+    if(block == -1)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    char key[MAX_NAME_SIZE];
+    DirSearch_MakeKey(key, name);
+    int pos = DirSearch_Block(leaf.entries, leaf.count, key);
+    if(pos == -1)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    int index = leaf.entries[pos].index;
+    memmove(&leaf.entries[pos], &leaf.entries[pos+1], (leaf.count - pos - 1) * sizeof(directory_entry_t));
+    leaf.count--;
+    memset(&leaf.entries[leaf.count], 0, sizeof(directory_entry_t));
+    dir->size = dir->size - sizeof(directory_entry_t);
+
+    if(leaf.count > 0 || depth == 0)
+    {
+        if(leaf.count == 0)
+        {
+            //l arbre est vide
+            _free_databloc(block);
+            dir->pointers[0] = -1;
+            return index;
+        }
+        return _write_btree_node(block, &leaf) == -1 ? -1 : index;
+    }
+
+    //feuille vide: la feuille precedente doit sauter par dessus
+    btree_node_t node;
+    for(int l = depth - 1; l >= 0; l--)
+    {
+        if(childPos[l] > 0)
+        {
+            if( _read_btree_node(path[l], &node) == -1)
+            {
+                return -1;
+            }
+            int prev = node.entries[childPos[l] - 1].index;
+            if( _read_btree_node(prev, &node) == -1)
+            {
+                return -1;
+            }
+            while(!node.leaf)
+            {
+                prev = node.entries[node.count - 1].index;
+                if( _read_btree_node(prev, &node) == -1)
+                {
+                    return -1;
+                }
+            }
+            node.next = leaf.next;
+            if( _write_btree_node(prev, &node) == -1)
+            {
+                return -1;
+            }
+            break;
+        }
+    }
+    _free_databloc(block);
+
+    //retrait du fils dans les noeuds internes, en remontant tant qu ils se vident
+    for(int l = depth - 1; l >= 0; l--)
+    {
+        if( _read_btree_node(path[l], &node) == -1)
+        {
+            return -1;
+        }
+        int c = childPos[l];
+        memmove(&node.entries[c], &node.entries[c+1], (node.count - c - 1) * sizeof(directory_entry_t));
+        node.count--;
+        memset(&node.entries[node.count], 0, sizeof(directory_entry_t));
+        if(node.count > 0)
+        {
+            if( _write_btree_node(path[l], &node) == -1)
+            {
+                return -1;
+            }
+            break;
+        }
+        _free_databloc(path[l]);
+        if(l == 0)
+        {
+            dir->pointers[0] = -1;
+        }
+    }
+
+    //une racine interne a un seul fils est inutile
+    while(dir->pointers[0] != -1)
+    {
+        if( _read_btree_node(dir->pointers[0], &node) == -1)
+        {
+            return -1;
+        }
+        if(node.leaf || node.count > 1)
+        {
+            break;
+        }
+        _free_databloc(dir->pointers[0]);
+        dir->pointers[0] = node.entries[0].index;
+    }
+    return index;
+}
+
+//liberation de tous les noeuds de l arbre
+int _btree_free(int dbIndex)
+{
+    btree_node_t node;
+    if( _read_btree_node(dbIndex, &node) == -1)
+    {
+        return -1;
+    }
+    if(!node.leaf)
+    {
+        for(int i = 0; i < node.count; i++)
+        {
+            _btree_free(node.entries[i].index);
+        }
+    }
+    return _free_databloc(dbIndex);
+}
+
+/*
+ * Copie dans out d au plus count entrees, dans l ordre des noms,
+ * a partir du premier nom strictement apres after (NULL ou "" pour le debut)
+ * cout: une descente dans l arbre puis les feuilles lues
+ */
+int _btree_read_from(const inode_bloc_t* dir, const char* after, directory_entry_t* out, int count)
+{
+    char key[MAX_NAME_SIZE];
+    int hasKey = after != NULL && after[0] != '\0';
+    if(hasKey)
+    {
+        DirSearch_MakeKey(key, after);
+    }
+    btree_node_t leaf;
+    int block = _btree_find_leaf(dir, hasKey ? key : NULL, &leaf, NULL, NULL, NULL);
+    if(block == -1)
+    {
+        return 0;
+    }
+    int pos = 0;
+    if(hasKey)
+    {
+        while(pos < leaf.count && strncmp(leaf.entries[pos].name, key, MAX_NAME_SIZE) <= 0)
+        {
+            pos++;
+        }
+    }
+    int nb = 0;
+    while(nb < count)
+    {
+        if(pos >= leaf.count)
+        {
+            if(leaf.next == -1)
+            {
+                break;
+            }
+            if( _read_btree_node(leaf.next, &leaf) == -1)
+            {
+                return -1;
+            }
+            pos = 0;
+            continue;
+        }
+        memcpy(out + nb, &leaf.entries[pos], sizeof(directory_entry_t));
+        nb++;
+        pos++;
+    }
+    return nb;
+}
+
+
+
+// Fonction elementaire pour liberer un bloc donnee
+// un bloc partage perd seulement une reference
+int _free_databloc(int index)
+{
+    int shares = _bloc_shares(index);
+    if(shares > 0)
+    {
+        return _set_bloc_shares(index, shares - 1);
+    }
+    databloc_bitmap_t dbmap;
+    if(shares == -1 || _loadDBMap((char*)&dbmap.map) == -1)
+    {
+        return -1;
+    }
+    _setpos((char*)&dbmap.map, index, 0 );
+    return _writeDBMap((char*)&dbmap.map);
+};
+
+//nombre de fichiers en plus du premier qui voient le bloc db, -1 en cas d erreur
+int _bloc_shares(int db)
+{
+    superblock_t* sbloc = _superbloc();
+    if(sbloc == NULL)
+    {
+        return -1;
+    }
+    if(sbloc->refcount_table == 0)
+    {
+        return 0;
+    }
+    unsigned short counts[SECTOR_SIZE / 2];
+    int sector = DB_OFFSET + sbloc->refcount_table - 1 + db / (SECTOR_SIZE / 2);
+    if(_meta_read(sector, (char*) counts) == -1)
+    {
+        return -1;
+    }
+    return counts[db % (SECTOR_SIZE / 2)];
+}
+
+//la table des partages est creee au premier bloc partage
+int _set_bloc_shares(int db, int shares)
+{
+    superblock_t* sbloc = _superbloc();
+    if(sbloc == NULL)
+    {
+        return -1;
+    }
+    if(sbloc->refcount_table == 0)
+    {
+        if(shares == 0)
+        {
+            return 0;
+        }
+        int first = _find_take_free_run(REFCOUNT_TABLE_BLOCS);
+        if(first == -1)
+        {
+            osErrno = E_NO_SPACE;
+            return -1;
+        }
+        Sector zero;
+        memset(&zero, 0, sizeof(Sector));
+        for(int i = 0; i < REFCOUNT_TABLE_BLOCS; i++)
+        {
+            if(_meta_write(DB_OFFSET + first + i, (char*) &zero) == -1)
+            {
+                return -1;
+            }
+        }
+        sbloc->refcount_table = first + 1;
+        if(_meta_write(0, (char*) sbloc) == -1)
+        {
+            _sbloc_valid = 0;
+            return -1;
+        }
+    }
+    unsigned short counts[SECTOR_SIZE / 2];
+    int sector = DB_OFFSET + sbloc->refcount_table - 1 + db / (SECTOR_SIZE / 2);
+    if(_meta_read(sector, (char*) counts) == -1)
+    {
+        return -1;
+    }
+    counts[db % (SECTOR_SIZE / 2)] = shares;
+    return _meta_write(sector, (char*) counts);
+}
+
+//copie du contenu du bloc de donnees from dans le bloc to
+int _copy_bloc(int from, int to)
+{
+    char* src = Cache_Get(DB_OFFSET + from, 1);
+    char* dest = src == NULL ? NULL : Cache_Get(DB_OFFSET + to, 0);
+    if(dest == NULL)
+    {
+        if(src != NULL)
+        {
+            Cache_Release(src, 0);
+        }
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    memcpy(dest, src, SECTOR_SIZE);
+    Cache_Release(dest, 1);
+    Cache_Release(src, 0);
+    return 0;
+}
+
+/*
+ * Une reference de plus sur le bloc db; retourne db, ou une copie quand le
+ * compteur est plein. Un trou (-1) reste un trou
+ */
+int _share_bloc(int db)
+{
+    if(db == -1)
+    {
+        return -1;
+    }
+    int shares = _bloc_shares(db);
+    if(shares == -1)
+    {
+        return -2;
+    }
+    if(shares < MAX_BLOC_SHARES)
+    {
+        return _set_bloc_shares(db, shares + 1) == -1 ? -2 : db;
+    }
+    int copy = _find_take_free_databloc();
+    if(copy == -1)
+    {
+        osErrno = E_NO_SPACE;
+        return -2;
+    }
+    if(_copy_bloc(db, copy) == -1)
+    {
+        return -2;
+    }
+    return copy;
+}
+
+/*
+ * Avant d ecrire dans le bloc b du fichier: s il est partage, le fichier recoit
+ * sa propre copie (copie sur ecriture)
+ */
+int _unshare_bloc(inode_bloc_t* inode_ptr, int b)
+{
+    int db = inode_ptr->pointers[b];
+    int shares = db == -1 ? 0 : _bloc_shares(db);
+    if(shares <= 0)
+    {
+        return shares;
+    }
+    int copy = _find_take_free_databloc();
+    if(copy == -1)
+    {
+        osErrno = E_NO_SPACE;
+        return -1;
+    }
+    if(_copy_bloc(db, copy) == -1)
+    {
+        return -1;
+    }
+    inode_ptr->pointers[b] = copy;
+    return _set_bloc_shares(db, shares - 1);
+}
+
+//fonction elementaire pour avoir un nouveau bloc donnees
+int _allocate_new_databloc()
+{
+ return _find_take_free_databloc();
+};
+
+
+
+/*copie tout le contenu du fichier dans ptr*/
+
+int _copy_file_content(void* ptr, const inode_bloc_t* inode_ptr)
+{
+    //ici simple utilisation de la fonction existante
+    int toRead = inode_ptr->size;
+    return _read_file_content(ptr,0,toRead,inode_ptr) == -1 ? -1 : 0;
+};
+
+
+
+int _getinodeByNumber(const int num, inode_bloc_t* ptr)
+{
+    //calcule simple pour transformer les coordonnees correctement
+  //un fichier ouvert a son inode en memoire
+  incore_inode_t* in = num >= 0 && num < MAX_INODES ? _incore_inodes[num] : NULL;
+  if(in != NULL && in->valid)
+  {
+    memcpy(ptr, &in->inode, sizeof(inode_bloc_t));
+    return 0;
+  }
+  int ind = num / 4;  //indice du bloc
+  int p = num % 4;    // indice interne
+  inode_bloc_t sect_in[4]; //bloc complet d'inodes
+  //lecture a partir de l offset des inodes
+  if  (_meta_read(INODE_OFFSET+ind, (char *) sect_in)  == -1 ) {
+    perror("Disk_Read() failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+  //copie du resultat car nous avons recupere trop d informations
+  memcpy(ptr,sect_in+p,sizeof(inode_bloc_t));
+  if(in != NULL)
+  {
+    in->inode = *ptr;
+    in->valid = 1;
+  }
+  return 0;
+};
+
+int _setinodeByNumber(const int num, inode_bloc_t* ptr)
+{
+  int ind = num / 4;  //indice du bloc
+  int p = num % 4;    // indice interne
+  //seul l inode qui nous interesse est ecrit, sans relire ses voisins du secteur
+  if  (_meta_patch(INODE_OFFSET+ind, p * sizeof(inode_bloc_t), ptr, sizeof(inode_bloc_t))  == -1 ) {
+    perror("Disk_Write() failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+  //dans une transaction, _meta_end invalide la copie si le secteur n est pas ecrit
+  if(_incore_inodes[num] != NULL)
+  {
+    _incore_inodes[num]->inode = *ptr;
+    _incore_inodes[num]->valid = 1;
+  }
+// tout est ok
+  return 0;
+};
+
+//inode en memoire de num, cree au premier descripteur ouvert dessus
+incore_inode_t* _incore_acquire(int num)
+{
+  incore_inode_t* in = _incore_inodes[num];
+  if(in == NULL)
+  {
+    in = calloc(1, sizeof(incore_inode_t));
+    if(in == NULL)
+    {
+      return NULL;
+    }
+    in->num = num;
+    _incore_inodes[num] = in;
+  }
+  in->refcount++;
+  return in;
+}
+
+//l inode quitte la memoire avec son dernier descripteur
+void _incore_release(incore_inode_t* in)
+{
+  if(--in->refcount > 0)
+  {
+    return;
+  }
+  _incore_inodes[in->num] = NULL;
+  free(in);
+}
+
+//les inodes du secteur seront relus
+void _incore_invalidate_sector(int sector)
+{
+  if(sector < INODE_OFFSET || sector >= DB_OFFSET)
+  {
+    return;
+  }
+  for(int num = (sector - INODE_OFFSET) * 4; num < (sector - INODE_OFFSET + 1) * 4; num++)
+  {
+    if(_incore_inodes[num] != NULL)
+    {
+      _incore_inodes[num]->valid = 0;
+    }
+  }
+}
+
+
+//fonction pour formatee le disque
+int _createAndFormatNewDisc()
+{
+    if( formatDisc() == -1)
+    {
+        perror("Error on format disc");
+        return -1;
+    } ;
+    return 0;
+}
+
+
+
+//fonction utile pour trouver le repertoire contenant dans un chemin
+int _copy_trim_last_token(char* destPath, const char* srcPath)
+{
+    if(srcPath[0] != '/')
+    {
+        perror("Absolute path required");
+        return -1;
+    }
+    strcpy(destPath,srcPath);
+    int i = strlen(destPath);
+    for(; (destPath[i] != '/') && (i >=0) ; i--)
+    {
+        //
+    }
+    if(i == 0) // cas de la racine
+    {
+        destPath[i+1] = '\0';
+        return 0;
+    }else
     {
         //autre cas nous coupons a patir de caractere /
         destPath[i] = '\0';
@@ -420,665 +2052,2102 @@ int _copy_trim_last_token(char* destPath, const char* srcPath)
 }
 
 
-//avoir le dernier token
-int _get_last_token(char* dest, const char* path)
+//avoir le dernier token
+int _get_last_token(char* dest, const char* path)
+{
+    int i = strlen(path);
+    char localname[MAX_NAME_SIZE];
+    int j = 0;
+    for(; (path[i] != '/') && (i >=0) && j < MAX_NAME_SIZE; i--, j++)
+    {
+        localname[j] = path[i];
+    }
+    localname[j] = '\0';
+    int k=0;
+    for( ; k < j;k++)
+    {
+        dest[k] = localname[j-k-1];
+    }
+    dest[k] = '\0';
+    return 0;
+}
+
+//copie du chemin path le path contenant et le nom du fichier
+int _get_containing_path_and_lastname(char* containingpath, char* lastToken, const char* path)
+{
+    if(_get_last_token(lastToken,path) != 0) return -1;
+    if(_copy_trim_last_token(containingpath,path) != 0) return -1;
+    return 0;
+}
+
+
+int _readbit(char c, int pos) {
+  char conv[]={0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40 , 0x80 };
+
+  if (pos < 0 || pos > 7) {
+    perror("bit: incorrect position \n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    c = c & conv[pos];
+    if (c == '\0')
+    return 0;
+    else
+    return 1;
+}
+
+int _setbit(char* c, int pos, int val) {
+  //char conv[]={0x80, 0x40,  0x20, 0x10,  0x08, 0x04, 0x02, 0x01};
+  //char anticonv[]={0x7F, 0xBF, 0xDF, 0xEF, 0xF7, 0xFB, 0xFD, 0xFE};
+  char conv[]={0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40 , 0x80 };
+  char anticonv[]={0xFE, 0xFD, 0xFB,  0xF7, 0xEF, 0xDF, 0xBF, 0x7F  };
+  if (pos < 0 || pos > 7) {
+    perror("bit: incorrect position \n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+  if (val < 0 || val > 1) {
+    perror("bit: incorrect value \n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    if (val == 1)
+        *c = (*c) | conv[pos];
+    else
+        *c = (*c) & anticonv[pos];
+    return 0;
+}
+
+
+
+int  _readpos(char * map, int pos)  // retourne le bit M[pos]
+{
+  if (pos < 0 || pos > 8191) {
+    perror("bit: incorrect position \n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+  int ind = pos / 8;
+  int p = pos % 8;
+   return _readbit(map[ind],p);
+}
+
+
+
+
+int  _setpos(char * map, int pos, int val)
+{
+  if (pos < 0 || pos > 8191) {
+    perror("bit: incorrect position \n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+  if (val < 0 || val > 1) {
+    perror("bit: incorrect value \n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+  int ind = pos / 8;
+  int p = pos % 8;
+   return _setbit(map+ind,p,val);
+}
+
+//limit: nombre de bits de la carte qui designent quelque chose qui existe
+int _findfreeFromMap(char * map, int limit)
+{
+  int i;
+  for(i=0; i < limit; i++) {
+  //un octet plein n a aucun bit libre
+  if ((i % 8) == 0 && (byte) map[i/8] == 0xFF) { i += 7; continue; }
+  if (_readpos(map,i)==0)  break;
+  }
+  if (i >= limit)
+  {
+    perror("bitmap is full \n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+   return i;
+}
+
+
+int _loadInodeMap(char* map)
+{
+    if ( (_meta_read(1, map)  == -1) || (_meta_read(2, map+512)  == -1) ) {
+    perror("Disk_Read() Imap failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    return 0;
+}
+
+
+int _loadDBMap(char* map)
+{
+    if ( (_meta_read(3, map)  == -1) || (_meta_read(4, map+512)  == -1) ) {
+    perror("Disk_Read() Imap failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    return 0;
+}
+
+int _writeDBMap(const char* map)
+{
+    if ( (_meta_write(3, (char*) map)  == -1) || (_meta_write(4, (char*)map+512)  == -1) ) {
+    perror("Disk_Write() DB failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    return 0;
+}
+
+int _writeInodeMap(const char* map)
+{
+    if ( (_meta_write(1, (char*) map)  == -1) || (_meta_write(2, (char*)map+512)  == -1) ) {
+    perror("Disk_Write() DB failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    return 0;
+}
+
+
+
+int _find_free_databloc()
+{
+    char map[1024];
+    _loadDBMap(map);
+    return _findfreeFromMap(map, NB_DATA_BLOCS);
+}
+
+
+
+int _find_take_free_databloc()
+{
+    databloc_bitmap_t dbmap;
+    _loadDBMap((char*)&dbmap.map);
+    //en mode journal le bloc est pris apres le dernier alloue
+    int head = _log_head();
+    int i = head == -1 ? _findfreeFromMap((char*)&dbmap.map, NB_DATA_BLOCS) : _find_free_run((char*)&dbmap.map, head, 1, NB_DATA_BLOCS);
+    if(i == -1)
+    {
+        perror("Error to find free bloc");
+        return -1;
+    }
+    _setpos((char*)&dbmap.map, i, 1);
+    _writeDBMap((char*)&dbmap.map);
+    if(head != -1)
+    {
+        _set_log_head(i + 1);
+    }
+    return i;
+}
+
+/*
+ * Premiere suite de count bits libres de la carte dans [start, limit), sinon
+ * dans [0, limit); -1 s il n y en a pas
+ */
+int _find_free_run(char* map, int start, int count, int limit)
+{
+    for(int from = start; ; from = 0)
+    {
+        int run = 0;
+        for(int i = from; i < limit; i++)
+        {
+            run = _readpos(map, i) ? 0 : run + 1;
+            if(run == count)
+            {
+                return i - count + 1;
+            }
+        }
+        if(from == 0)
+        {
+            return -1;
+        }
+    }
+}
+
+int _find_take_free_run(int count)
+{
+    databloc_bitmap_t dbmap;
+    if(count <= 0 || _loadDBMap((char*)&dbmap.map) == -1)
+    {
+        return -1;
+    }
+    int head = _log_head();
+    int first = head == -1 ? _find_free_run((char*)&dbmap.map, 0, count, NB_DATA_BLOCS) : _find_free_run((char*)&dbmap.map, head, count, NB_DATA_BLOCS);
+    if(first == -1)
+    {
+        return -1;
+    }
+    for(int j = first; j < first + count; j++)
+    {
+        _setpos((char*)&dbmap.map, j, 1);
+    }
+    _writeDBMap((char*)&dbmap.map);
+    if(head != -1)
+    {
+        _set_log_head(first + count);
+    }
+    return first;
+}
+
+//prochain bloc de donnees a allouer en mode journal, -1 hors mode journal
+int _log_head()
+{
+    superblock_t* sbloc = _superbloc();
+    if(sbloc == NULL || sbloc->log_head == 0)
+    {
+        return -1;
+    }
+    return sbloc->log_head - 1;
+}
+
+int _set_log_head(int next)
+{
+    superblock_t* sbloc = _superbloc();
+    if(sbloc == NULL)
+    {
+        return -1;
+    }
+    sbloc->log_head = next % NB_DATA_BLOCS + 1;
+    if(_meta_write(0, (char*) sbloc) == -1)
+    {
+        _sbloc_valid = 0;
+        return -1;
+    }
+    return 0;
+}
+
+int _find_take_free_inode()
+{
+    inode_bitmap_t inmap;
+    _loadInodeMap((char*)&inmap.map);
+    int i = _findfreeFromMap((char*)&inmap.map, MAX_INODES);
+    if(i == -1)
+    {
+        perror("Error to find free bloc");
+        return -1;
+    }
+    _setpos((char*)&inmap.map, i, 1);
+    _writeInodeMap((char*)&inmap.map);
+    return i;
+}
+
+
+int _create_new_directory_entry(int index, const char* newEntryName, int entryType)
+{
+    inode_bloc_t inode; // une buffer de travail
+
+    //l inode, les eclatements de seaux et l entree sont ecrits ensemble au commit:
+    //un echec au milieu ne laisse ni entree deplacee perdue ni bloc pris
+    if( _meta_begin() == -1)
+    {
+        return -1;
+    }
+    if( _getinodeByNumber(index, &inode) != 0)
+    {
+        _meta_abort();
+        return -1;
+    };
+    if( !_is_directory(inode.type) )
+    {
+        _meta_abort();
+        osErrno = E_GENERAL;
+        return -1;
+    }
+
+    //verifier que le nom n existe pas deja: un seul seau a lire
+    if ( _dir_lookup(&inode, newEntryName) != -1 )
+    {
+        _meta_abort();
+        perror("Key already exists ");
+        osErrno = E_CREATE;
+        return -1;
+    }
+
+    int newdirindex = -1;
+
+    if(entryType == DIRECTORY_TYPE)
+    {
+        newdirindex = _create_new_directory_inode();
+    }
+    else if(entryType == ORDERED_DIRECTORY_TYPE)
+    {
+        newdirindex = _create_new_inode(ORDERED_DIRECTORY_TYPE);
+    }
+    else
+    {
+        newdirindex = _create_new_file_inode();
+    }
+    if(newdirindex == -1)
+    {
+        _meta_abort();
+        perror("error on _create_new_directory_inode");
+        return -1;
+    }
+
+    //ecriture de la nouvelle entree dans son seau uniquement
+    if( _dir_insert_entry(&inode, newEntryName, newdirindex) == -1)
+    {
+        _meta_abort();
+        perror("Error on write content of directory");
+        return -1;
+    }
+
+    //le contenu du repertoire est copie maintenant je mets a jour l inode du repertoire
+    if( _setinodeByNumber(index,&inode) == -1 || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+
+    //l entree negative eventuelle du cache devient positive
+    Dentry_Insert(index, newEntryName, newdirindex);
+    return 0;
+};
+
+int _create_new_inode(int type)
+{
+    int index = _find_take_free_inode();
+    if(index == -1)
+    {
+        perror("Cannot find a new inode to create the directory");
+        return -1;
+    }
+    //load the inode table and set is to the correct values
+    int ind = index / 4; //num de secteur
+    int p = index % 4;
+    Sector sect_inout;
+    if  (_meta_read(INODE_OFFSET+ind, (char *) &sect_inout.data)  == -1 ) {
+    perror("Disk_Read() failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    inode_bloc_t inode_local;
+    inode_local.type = type;
+    inode_local.size = 0;
+    memset(inode_local.pointers,-1,30*sizeof(int));
+
+    memcpy(((inode_bloc_t *) &sect_inout.data)+p,&inode_local,sizeof(inode_bloc_t));
+
+    if  (_meta_write(INODE_OFFSET+ind, (char *) &sect_inout.data)  == -1 ) {
+    perror("Disk_Write() failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    return index;
+};
+
+//demande d une inode libre
+int _create_new_directory_inode()
+{
+    return _create_new_inode(DIRECTORY_TYPE);
+};
+int _create_new_file_inode()
+{
+    return _create_new_inode(FILE_TYPE);
+};
+
+//--//
+int _path_2_inode(const char* path, inode_bloc_t* ptr, int* retIndex)
+{
+    int  index =_path_2_inode_number(path);
+    if(index == -1) {return -1;}
+    if(retIndex != NULL) {*retIndex = index;}
+
+    return _getinodeByNumber(index, ptr);
+}
+
+int _find_take_free_descriptor()
+{
+    if(_free_descriptor == -1 && _grow_open_file_table() == -1)
+    {
+        return -1;
+    }
+    int i = _free_descriptor;
+    _free_descriptor = _open_file_table[i].next_free;
+    _open_file_table[i].used = 1;
+    return i;
+}
+
+void _release_descriptor(int fd)
+{
+    if(_open_file_table[fd].incore != NULL)
+    {
+        _incore_release(_open_file_table[fd].incore);
+        _open_file_table[fd].incore = NULL;
+    }
+    _open_file_table[fd].used = 0;
+    _open_file_table[fd].inode_index = -1;
+    _open_file_table[fd].next_free = _free_descriptor;
+    _free_descriptor = fd;
+}
+
+
+
+//**************88
+/* Section des fonctions principales
+ */
+//**************88
+
+//sync du disque
+int
+FS_Sync()
+{
+    //FS_Syn: les tampons d ecriture des descripteurs vont dans le cache, puis le
+    //cache garde les secteurs modifies, ils doivent etre sur le disque avant la sauvegarde
+    for(int fd = 0; fd < _open_file_capacity; fd++)
+    {
+        if(_open_file_table[fd].used && _flush_write_buffer(&_open_file_table[fd]) == -1)
+        {
+            perror("FS_Sync()");
+            return -1;
+        }
+    }
+    if( Cache_Flush() == -1 || Disk_Save(fileName) == -1)
+    {
+        perror("FS_Sync()");
+        return -1;
+    };
+    return 0;
+}
+
+
+
+/*
+ * Mode journal du volume (enable a 1), garde dans le superbloc: les blocs de
+ * donnees sont alloues les uns a la suite des autres a partir du dernier bloc
+ * occupe, en revenant au debut du disque a la fin, au lieu du premier bloc
+ * libre. Les ajouts a des fichiers differents se suivent ainsi sur le disque
+ */
+int FS_SetLogMode(int enable)
+{
+    superblock_t* sbloc = _superbloc();
+    if(sbloc == NULL)
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    if(!enable)
+    {
+        sbloc->log_head = 0;
+    }
+    else if(sbloc->log_head == 0)
+    {
+        databloc_bitmap_t dbmap;
+        if(_loadDBMap((char*)&dbmap.map) == -1)
+        {
+            return -1;
+        }
+        int last = NB_DATA_BLOCS - 1;
+        while(last >= 0 && !_readpos((char*)&dbmap.map, last))
+        {
+            last--;
+        }
+        sbloc->log_head = (last + 1) % NB_DATA_BLOCS + 1;
+    }
+    if(Cache_Write(0, (char*) sbloc) == -1)
+    {
+        _sbloc_valid = 0;
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    return 0;
+}
+
+//fonction de boot
+int
+FS_Boot(char *path)
+{
+    fileName = path;
+    Dentry_Reset();
+    for(int it = 0; it < MAX_OPEN_DIR_ITERS; it++)
+    {
+        if(_dir_iter_table[it].used)
+        {
+            _incore_release(_incore_inodes[_dir_iter_table[it].inode_index]);
+        }
+    }
+    memset(_dir_iter_table, 0, sizeof(_dir_iter_table));
+    for(int dh = 0; dh < MAX_OPEN_DIRS; dh++)
+    {
+        if(_dir_handle_table[dh].used)
+        {
+            _incore_release(_incore_inodes[_dir_handle_table[dh].inode_index]);
+        }
+    }
+    memset(_dir_handle_table, 0, sizeof(_dir_handle_table));
+    //les fenetres directes retiennent des secteurs du cache
+    for(int m = 0; m < MAX_FILE_MAPS; m++)
+    {
+        if(_file_map_table[m].used)
+        {
+            if(_file_map_table[m].direct)
+            {
+                Cache_Release(_file_map_table[m].addr, 0);
+            }
+            else
+            {
+                free(_file_map_table[m].addr);
+            }
+        }
+        _file_map_table[m].used = 0;
+    }
+    //le cache ne doit rien garder de l image precedente, ni les tampons d ecriture;
+    //une vue de File_ReadView encore tenue l en empeche
+    if (Cache_Reset() == -1) {
+    perror("Cache_Reset() failed, views still held\n");
+    osErrno = E_FILE_IN_USE;
+    return -1;
+    }
+    _sbloc_valid = 0;
+    if (Disk_Init() == -1) {
+    perror("Disk_Init() failed\n");
+    osErrno = E_GENERAL;
+    return -1;
+    }
+    for(int fd = 0; fd < _open_file_capacity; fd++)
+    {
+        _open_file_table[fd].wbuf_len = 0;
+    }
+    //les inodes des fichiers ouverts sont relus de la nouvelle image
+    for(int num = 0; num < MAX_INODES; num++)
+    {
+        if(_incore_inodes[num] != NULL)
+        {
+            _incore_inodes[num]->valid = 0;
+        }
+    }
+
+    //Chargement du fichier image
+    if ( Disk_Load(path) == -1)
+    {
+        //Disk_Load() failed;
+        if(diskErrno == E_OPENING_FILE) // si le fichier n existe pas je dois le creer
+        {
+            if( _createAndFormatNewDisc() == -1 )
+            {
+                osErrno = E_GENERAL;
+                return -1;
+            };
+        }
+        else
+        {
+        osErrno = E_GENERAL;
+        return -1;
+        }
+    }
+    //disque est charge dans la memoire
+    //verification du magic number; le superbloc reste ensuite en memoire
+    superblock_t* sbloc = _superbloc();
+    if(sbloc != NULL && sbloc->magicnumber == MAGICNUMBER && sbloc->version == FS_VERSION)
+    {
+        // Image disque OK
+        return 0;
+    }
+    else
+    {
+        perror("Erreur dans l'image disque");
+        return -1;
+    }
+
+}
+
+
+
+//fonction deleguee pour creation d un repertoire du format type
+int _dir_create(char *path, int type)
+{
+    char* pathcopy = alloca(strlen(path)+1);
+    if ( _copy_trim_last_token(pathcopy,path) != 0)
+    {
+        perror("Error on path creation");
+        return -1;
+    };
+
+    int index = _path_2_inode_number(pathcopy);
+    if(index == -1)
+    {
+        perror("cannot find directory\n");
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+
+
+    //ajout d une nouvelle entree de type repertoire dans cette inode
+    char newEntryName[MAX_NAME_SIZE];
+    _get_last_token(newEntryName,path);
+    if( _create_new_directory_entry(index,newEntryName, type) == -1)
+    {
+        osErrno = E_CREATE;
+        return -1;
+    }
+    return 0;
+}
+
+// directory ops
+int Dir_Create(char *path) //PP
+{
+    return _dir_create(path, DIRECTORY_TYPE);
+}
+
+//repertoire dont les entrees sont gardees triees par nom
+int Dir_CreateOrdered(char *path)
+{
+    return _dir_create(path, ORDERED_DIRECTORY_TYPE);
+}
+
+
+
+int
+Dir_Size(char *path)
+{
+    int index = _path_2_inode_number(path);
+    if(index == -1)
+    {
+        return -1;
+    }
+    inode_bloc_t bloc;
+    if(_getinodeByNumber(index,&bloc) == -1)
+    {
+        return -1;
+    };
+    if( !_is_directory(bloc.type))
+    {
+        return -1;
+    };
+    return bloc.size;
+}
+
+int Dir_Read(char *path, void *buffer, int size)
+{
+    //Dir_Read
+    int index = _path_2_inode_number(path);
+    if(index == -1)
+    {
+        return -1;
+    }
+    return _dir_read_index(index, buffer, size);
+}
+
+//contenu du repertoire d index donne
+int _dir_read_index(int index, void *buffer, int size)
+{
+    //get directory inode
+    inode_bloc_t inode;
+    if( _getinodeByNumber( index , &inode ) == -1)
+    {
+    osErrno = E_NO_SUCH_FILE;
+    return -1;
+    }
+    if( !_is_directory(inode.type))
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    if(inode.size > size)
+    {
+        osErrno = E_BUFFER_TOO_SMALL;
+        return -1;
+    }
+    //copie des entrees occupees de chaque seau, bloc par bloc
+    directory_entry_t* out = (directory_entry_t*) buffer;
+    if(inode.type == ORDERED_DIRECTORY_TYPE)
+    {
+        //parcours des feuilles: les entrees sortent triees
+        return _btree_read_from(&inode, NULL, out, inode.size / sizeof(directory_entry_t));
+    }
+    int nb = 0;
+    int nbBuckets = _dir_bucket_count(&inode);
+    for(int b = 0; b < nbBuckets; b++)
+    {
+        directory_bloc_t bloc;
+        if( _read_dir_bloc(inode.pointers[b], &bloc) == -1)
+        {
+            return -1;
+        }
+        for(int i = 0; i < DIR_ENTRIES_PER_BLOC; i++)
+        {
+            if(bloc.used_map & (1 << i))
+            {
+                memcpy(out+nb, &bloc.entries[i], sizeof(directory_entry_t));
+                nb++;
+            }
+        }
+    }
+    return nb;
+}
+
+
+
+
+/*
+ * Lecture paginee dans l ordre des noms: au plus count entrees dont le nom est
+ * strictement apres after (NULL ou "" pour commencer au debut)
+ * repertoire ordonne: une descente dans l arbre puis les feuilles de la page;
+ * repertoire hache: tout le contenu est lu puis trie
+ */
+int Dir_ReadFrom(char *path, char *after, void *buffer, int count)
+{
+    inode_bloc_t inode;
+    if( _path_2_inode(path, &inode, NULL) != 0)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    if( !_is_directory(inode.type) || count < 0)
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    if(inode.type == ORDERED_DIRECTORY_TYPE)
+    {
+        return _btree_read_from(&inode, after, (directory_entry_t*) buffer, count);
+    }
+    int total = inode.size / sizeof(directory_entry_t);
+    directory_entry_t* all = alloca(inode.size + sizeof(directory_entry_t));
+    if( Dir_Read(path, all, inode.size) == -1)
+    {
+        return -1;
+    }
+    char** sorted = alloca((total + 1) * sizeof(char*));
+    for(int i = 0; i < total; i++)
+    {
+        sorted[i] = all[i].name;
+    }
+    qsort(sorted, total, sizeof(char*), _compare_names);
+    int nb = 0;
+    for(int i = 0; i < total && nb < count; i++)
+    {
+        if(after == NULL || after[0] == '\0' || strncmp(sorted[i], after, MAX_NAME_SIZE) > 0)
+        {
+            //le nom est le premier champ de l entree
+            memcpy((directory_entry_t*) buffer + nb, sorted[i], sizeof(directory_entry_t));
+            nb++;
+        }
+    }
+    return nb;
+}
+
+/*
+ * Lecture d un repertoire par curseur: un seul bloc en memoire quel que soit
+ * le nombre d entrees. Le curseur relit l inode a chaque changement de seau;
+ * une creation pendant le parcours peut deplacer des entrees entre seaux,
+ * qui seront alors vues deux fois ou pas du tout. Comme un handle de
+ * Dir_Open, le curseur garde l inode en memoire: le repertoire ne peut pas etre
+ * supprime avant le Dir_CloseIter
+ */
+int Dir_OpenIter(char *path)
+{
+    inode_bloc_t inode;
+    int index = -1;
+    if( _path_2_inode(path, &inode, &index) != 0)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    if( !_is_directory(inode.type))
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    int first = 0;
+    if(inode.type == ORDERED_DIRECTORY_TYPE)
+    {
+        //depart sur la feuille la plus a gauche
+        btree_node_t leaf;
+        first = _btree_find_leaf(&inode, NULL, &leaf, NULL, NULL, NULL);
+    }
+    for(int it = 0; it < MAX_OPEN_DIR_ITERS; it++)
+    {
+        if(!_dir_iter_table[it].used)
+        {
+            if(_incore_acquire(index) == NULL)
+            {
+                osErrno = E_GENERAL;
+                return -1;
+            }
+            _dir_iter_table[it].used = 1;
+            _dir_iter_table[it].inode_index = index;
+            _dir_iter_table[it].bucket = first;
+            _dir_iter_table[it].slot = 0;
+            _dir_iter_table[it].loaded = 0;
+            _dir_iter_table[it].ordered = inode.type == ORDERED_DIRECTORY_TYPE;
+            return it;
+        }
+    }
+    osErrno = E_TOO_MANY_OPEN_FILES;
+    return -1;
+}
+
+int Dir_Next(int it, void *entry)
+{
+    if( it < 0 || it >= MAX_OPEN_DIR_ITERS || !_dir_iter_table[it].used )
+    {
+        osErrno = E_BAD_FD;
+        return -1;
+    }
+    dir_iterator_t* iter = &_dir_iter_table[it];
+    for(;;)
+    {
+        if(!iter->loaded)
+        {
+            //chargement du seau suivant
+            inode_bloc_t inode;
+            if( _getinodeByNumber(iter->inode_index, &inode) == -1)
+            {
+                return -1;
+            }
+            if(iter->ordered)
+            {
+                //les feuilles sont chainees dans l ordre des noms
+                if(iter->bucket == -1)
+                {
+                    return 0;
+                }
+                if( _read_btree_node(iter->bucket, &iter->node) == -1)
+                {
+                    return -1;
+                }
+                iter->loaded = 1;
+                iter->slot = 0;
+                continue;
+            }
+            if( iter->bucket >= _dir_bucket_count(&inode) )
+            {
+                return 0; //fin du repertoire
+            }
+            if( _read_dir_bloc(inode.pointers[iter->bucket], &iter->bloc) == -1)
+            {
+                return -1;
+            }
+            iter->loaded = 1;
+            iter->slot = 0;
+        }
+        if(iter->ordered)
+        {
+            if(iter->slot < iter->node.count)
+            {
+                memcpy(entry, &iter->node.entries[iter->slot], sizeof(directory_entry_t));
+                iter->slot++;
+                return 1;
+            }
+            iter->bucket = iter->node.next;
+            iter->loaded = 0;
+            continue;
+        }
+        //les emplacements libres sont sautes grace a la carte
+        int remaining = iter->bloc.used_map & DIR_SLOTS_MASK & ~((1 << iter->slot) - 1);
+        if(remaining != 0)
+        {
+            int i = __builtin_ctz(remaining);
+            memcpy(entry, &iter->bloc.entries[i], sizeof(directory_entry_t));
+            iter->slot = i + 1;
+            return 1;
+        }
+        iter->bucket++;
+        iter->loaded = 0;
+    }
+}
+
+int Dir_CloseIter(int it)
+{
+    if( it < 0 || it >= MAX_OPEN_DIR_ITERS || !_dir_iter_table[it].used )
+    {
+        osErrno = E_BAD_FD;
+        return -1;
+    }
+    _incore_release(_incore_inodes[_dir_iter_table[it].inode_index]);
+    _dir_iter_table[it].used = 0;
+    return 0;
+}
+
+
+
+
+/*
+ * Repertoires ouverts: le chemin est resolu une fois par Dir_Open, les
+ * operations *At ne cherchent ensuite que le dernier composant
+ */
+int Dir_Open(char *path)
+{
+    inode_bloc_t inode;
+    int index = -1;
+    if( _path_2_inode(path, &inode, &index) != 0)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    if( !_is_directory(inode.type))
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    return _open_dir_handle(index);
+}
+
+//handle sur le repertoire d inode index, qui reste en memoire jusqu au Dir_Close
+int _open_dir_handle(int index)
+{
+    for(int dh = 0; dh < MAX_OPEN_DIRS; dh++)
+    {
+        if(!_dir_handle_table[dh].used)
+        {
+            if(_incore_acquire(index) == NULL)
+            {
+                osErrno = E_GENERAL;
+                return -1;
+            }
+            _dir_handle_table[dh].used = 1;
+            _dir_handle_table[dh].inode_index = index;
+            return dh;
+        }
+    }
+    osErrno = E_TOO_MANY_OPEN_FILES;
+    return -1;
+}
+
+int _dir_handle_inode(int dh)
+{
+    if( dh < 0 || dh >= MAX_OPEN_DIRS || !_dir_handle_table[dh].used )
+    {
+        osErrno = E_BAD_FD;
+        return -1;
+    }
+    return _dir_handle_table[dh].inode_index;
+}
+
+//sous-repertoire name du repertoire ouvert dh
+int Dir_OpenAt(int dh, char *name)
+{
+    int dirIndex = _dir_handle_inode(dh);
+    if(dirIndex == -1)
+    {
+        return -1;
+    }
+    int index = _lookup_component(dirIndex, name);
+    if(index == -1)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    inode_bloc_t inode;
+    if( _getinodeByNumber(index, &inode) == -1)
+    {
+        return -1;
+    }
+    if( !_is_directory(inode.type))
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    return _open_dir_handle(index);
+}
+
+int Dir_Close(int dh)
+{
+    if( _dir_handle_inode(dh) == -1)
+    {
+        return -1;
+    }
+    _incore_release(_incore_inodes[_dir_handle_table[dh].inode_index]);
+    _dir_handle_table[dh].used = 0;
+    return 0;
+}
+
+int Dir_ReadAt(int dh, void *buffer, int size)
+{
+    int dirIndex = _dir_handle_inode(dh);
+    if(dirIndex == -1)
+    {
+        return -1;
+    }
+    return _dir_read_index(dirIndex, buffer, size);
+}
+
+int File_CreateAt(int dh, char *name)
 {
-    int i = strlen(path);
-    char localname[MAX_NAME_SIZE];
-    int j = 0;
-    for(; (path[i] != '/') && (i >=0) && j < MAX_NAME_SIZE; i--, j++)
+    int dirIndex = _dir_handle_inode(dh);
+    if(dirIndex == -1)
     {
-        localname[j] = path[i];
+        return -1;
     }
-    localname[j] = '\0';
-    int k=0;
-    for( ; k < j;k++)
+    if( !_valid_entry_name(name))
     {
-        dest[k] = localname[j-k-1];
+        osErrno = E_CREATE;
+        return -1;
+    }
+    if( _create_new_directory_entry(dirIndex, name, FILE_TYPE) == -1)
+    {
+        perror("Cannot create a new file");
+        return -1;
     }
-    dest[k] = '\0';
     return 0;
 }
 
-//copie du chemin path le path contenant et le nom du fichier
-int _get_containing_path_and_lastname(char* containingpath, char* lastToken, const char* path)
+int File_OpenAt(int dh, char *name)
 {
-    if(_get_last_token(lastToken,path) != 0) return -1;
-    if(_copy_trim_last_token(containingpath,path) != 0) return -1;
-    return 0;
+    int dirIndex = _dir_handle_inode(dh);
+    if(dirIndex == -1)
+    {
+        return -1;
+    }
+    int inodeindex = _lookup_component(dirIndex, name);
+    if(inodeindex == -1)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    return _open_inode(inodeindex);
 }
 
 
-int _readbit(char c, int pos) {
-  char conv[]={0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40 , 0x80 };
 
-  if (pos < 0 || pos > 7) {
-    perror("bit: incorrect position \n");
-    osErrno = E_GENERAL;
-    return -1;
+int
+Dir_Unlink(char *path)
+{
+    if(strcmp(path,"/") == 0)
+    {
+        osErrno = E_ROOT_DIR;
+        return -1;
     }
-    c = c & conv[pos];
-    if (c == '\0')
-    return 0;
-    else
-    return 1;
-}
-
-int _setbit(char* c, int pos, int val) {
-  //char conv[]={0x80, 0x40,  0x20, 0x10,  0x08, 0x04, 0x02, 0x01};
-  //char anticonv[]={0x7F, 0xBF, 0xDF, 0xEF, 0xF7, 0xFB, 0xFD, 0xFE};
-  char conv[]={0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40 , 0x80 };
-  char anticonv[]={0xFE, 0xFD, 0xFB,  0xF7, 0xEF, 0xDF, 0xBF, 0x7F  };
-  if (pos < 0 || pos > 7) {
-    perror("bit: incorrect position \n");
-    osErrno = E_GENERAL;
-    return -1;
+    int size = Dir_Size(path);
+    if(size == -1)
+    {
+        return -1;
     }
-  if (val < 0 || val > 1) {
-    perror("bit: incorrect value \n");
-    osErrno = E_GENERAL;
-    return -1;
+    if(size != 0)
+    {
+        osErrno = E_DIR_NOT_EMPTY;
+        return -1;
     }
-    if (val == 1)
-        *c = (*c) | conv[pos];
-    else
-        *c = (*c) & anticonv[pos];
-    return 0;
-}
+    //Contenant ici
+    char* pathContenant = alloca(strlen(path)+1);
+    char name[MAX_NAME_SIZE];
+    inode_bloc_t inode;
+    int indexContenant;
 
+    if( _get_containing_path_and_lastname(pathContenant,name,path) != 0)
+    {
+        return -1;
+    }
+    if( _path_2_inode(pathContenant,&inode,&indexContenant) != 0)
+    {
+        return -1;
+    }
 
+    //un repertoire ouvert par Dir_Open ne peut pas disparaitre sous son handle
+    int target = _lookup_component(indexContenant, name);
+    if(target != -1 && _incore_inodes[target] != NULL)
+    {
+        osErrno = E_FILE_IN_USE;
+        return -1;
+    }
 
-int  _readpos(char * map, int pos)  // retourne le bit M[pos]
-{
-  if (pos < 0 || pos > 8191) {
-    perror("bit: incorrect position \n");
-    osErrno = E_GENERAL;
-    return -1;
+    //l entree, les seaux fusionnes, l inode libere et le repertoire contenant
+    //sont ecrits ensemble au commit
+    if( _meta_begin() == -1)
+    {
+        return -1;
     }
-  int ind = pos / 8;
-  int p = pos % 8;
-   return _readbit(map[ind],p);
+    //retrait de l entree dans son seau
+    int index = _dir_remove_entry(&inode,name);
+    //il faut liberer inode et ses seaux, puis la taille du repertoire contenant a change
+    if( index == -1 || _free_inode(index) == -1 ||
+        _setinodeByNumber(indexContenant,&inode) == -1 || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    Dentry_Insert(indexContenant, name, DENTRY_NEGATIVE);
+    Dentry_InvalidatePaths();
+    return 0;
 }
 
 
 
 
-int  _setpos(char * map, int pos, int val)
+//done
+int
+File_Open(char *file)
 {
-  if (pos < 0 || pos > 8191) {
-    perror("bit: incorrect position \n");
-    osErrno = E_GENERAL;
-    return -1;
-    }
-  if (val < 0 || val > 1) {
-    perror("bit: incorrect value \n");
-    osErrno = E_GENERAL;
-    return -1;
+    int inodeindex = _path_2_inode_number(file);
+    if ( inodeindex == -1)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
     }
-  int ind = pos / 8;
-  int p = pos % 8;
-   return _setbit(map+ind,p,val);
+    return _open_inode(inodeindex);
 }
 
-int _findfreeFromMap(char * map)
+//descripteur sur un inode deja resolu
+int _open_inode(int inodeindex)
 {
-  int i;
-  for(i=0; i < 8192; i++) {
-  if (_readpos(map,i)==0)  break;
-  }
-  if (i == 8192)
-  {
-    perror("bitmap is full \n");
-    osErrno = E_GENERAL;
-    return -1;
+    if(!_is_open_filetable_init) _init_open_file_table();
+    int des = _find_take_free_descriptor() ;
+    if ( des == -1)
+    {
+        osErrno = E_TOO_MANY_OPEN_FILES;
+        return -1;
     }
-   return i;
+    _open_file_table[des].read_write_index = 0;
+    _open_file_table[des].inode_index = inodeindex;
+    _open_file_table[des].next_sequential = -1;
+    _open_file_table[des].ra_window = 0;
+    _open_file_table[des].ra_next = 0;
+    _open_file_table[des].wbuf = NULL;
+    _open_file_table[des].wbuf_len = 0;
+    _open_file_table[des].incore = _incore_acquire(inodeindex);
+    if(_open_file_table[des].incore == NULL)
+    {
+        _release_descriptor(des);
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    return des;
 }
 
 
-int _loadInodeMap(char* map)
+
+
+
+//
+int
+File_Create(char *file)
 {
-    if ( (Disk_Read(1, map)  == -1) || (Disk_Read(2, map+512)  == -1) ) {
-    perror("Disk_Read() Imap failed\n");
-    osErrno = E_GENERAL;
-    return -1;
+    char filename[16];
+    char* containingPath = alloca(strlen(file)+1);
+    //avoir le chemin contenant et le nom du fichier a creer
+    if(
+    _get_containing_path_and_lastname(containingPath, filename, file)!= 0
+    )
+    {
+        return -1;
+    }
+    //avoir l inode du repertoire contenant
+    int inodeContainingDir = -1;
+    inode_bloc_t inode;
+
+    if(
+    _path_2_inode(containingPath,&inode, &inodeContainingDir)!= 0
+    )
+    {
+        return -1;
     }
-    return 0;
-}
 
 
-int _loadDBMap(char* map)
-{
-    if ( (Disk_Read(3, map)  == -1) || (Disk_Read(4, map+512)  == -1) ) {
-    perror("Disk_Read() Imap failed\n");
-    osErrno = E_GENERAL;
-    return -1;
+    //ajout une nouvelle entree dans le contenu du repeortoire contenant
+    if (_create_new_directory_entry(inodeContainingDir,filename, FILE_TYPE))
+    {
+        perror("Cannot create a new file");
+        return -1;
     }
     return 0;
 }
 
-int _writeDBMap(const char* map)
+//comparaison de deux noms pour le tri des noms d un lot
+int _compare_names(const void* a, const void* b)
 {
-    if ( (Disk_Write(3, (char*) map)  == -1) || (Disk_Write(4, (char*)map+512)  == -1) ) {
-    perror("Disk_Write() DB failed\n");
-    osErrno = E_GENERAL;
-    return -1;
-    }
-    return 0;
+    return strncmp(*(char* const*) a, *(char* const*) b, MAX_NAME_SIZE);
 }
 
-int _writeInodeMap(const char* map)
+/*
+ * Creation de n fichiers dans le repertoire dir en une seule transaction:
+ * les noms sont tous verifies avant toute modification, puis les entrees,
+ * les inodes et les bits des cartes sont modifies en memoire et chaque
+ * secteur touche est ecrit une seule fois. En cas d erreur rien n est ecrit.
+ */
+int
+File_CreateBatch(char *dir, char **names, int n)
 {
-    if ( (Disk_Write(1, (char*) map)  == -1) || (Disk_Write(2, (char*)map+512)  == -1) ) {
-    perror("Disk_Write() DB failed\n");
-    osErrno = E_GENERAL;
-    return -1;
+    if(n < 0 || (n > 0 && names == NULL))
+    {
+        osErrno = E_CREATE;
+        return -1;
+    }
+    int inodeDir = -1;
+    inode_bloc_t inode;
+    if( _path_2_inode(dir, &inode, &inodeDir) != 0)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    if(!_is_directory(inode.type))
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+
+    //verification des noms en une passe, puis doublons du lot par tri
+    char** sorted = alloca(n * sizeof(char*));
+    for(int i = 0; i < n; i++)
+    {
+        if(!_valid_entry_name(names[i]))
+        {
+            osErrno = E_CREATE;
+            return -1;
+        }
+        sorted[i] = names[i];
+    }
+    qsort(sorted, n, sizeof(char*), _compare_names);
+    for(int i = 1; i < n; i++)
+    {
+        if(_compare_names(&sorted[i-1], &sorted[i]) == 0)
+        {
+            osErrno = E_CREATE;
+            return -1;
+        }
+    }
+
+    if( _meta_begin() == -1)
+    {
+        return -1;
+    }
+    int* created = alloca(n * sizeof(int));
+    for(int i = 0; i < n; i++)
+    {
+        if( _dir_lookup(&inode, names[i]) != -1 )
+        {
+            _meta_abort();
+            osErrno = E_CREATE;
+            return -1;
+        }
+        //E_NO_SPACE par defaut, un appele qui echoue pour une autre raison
+        //(lecture d un seau, d une carte...) garde son propre code
+        osErrno = E_NO_SPACE;
+        created[i] = _create_new_file_inode();
+        if( created[i] == -1 || _dir_insert_entry(&inode, names[i], created[i]) == -1 )
+        {
+            _meta_abort();
+            return -1;
+        }
+    }
+    if( _setinodeByNumber(inodeDir, &inode) == -1 || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        Dentry_Insert(inodeDir, names[i], created[i]);
     }
     return 0;
 }
 
-
-
-int _find_free_databloc()
+//read
+int
+File_Read(int fd, void *buffer, int size)
 {
-    char map[1024];
-    _loadDBMap(map);
-    return _findfreeFromMap(map);
-}
-
-
+    // verifier que fd pointe sur une inode ouverte
+    if( fd >= 0 && fd < _open_file_capacity && _open_file_table[fd].used && _open_file_table[fd].inode_index != -1  )
+    {
+            //lecture du contenu du fichier a partir du numero d inode
+            inode_bloc_t inode;
+            if(size < 0)
+            {
+                osErrno = E_GENERAL;
+                return -1;
+            }
+            //le descripteur doit relire ce qu il vient d ecrire
+            if(_flush_write_buffer(&_open_file_table[fd]) == -1)
+            {
+                return -1;
+            }
+            if(_getinodeByNumber(_open_file_table[fd].inode_index, &inode) == -1)
+            {
+                return -1;
+            }
+            int ret = _read_file_content(
+                buffer,
+                _open_file_table[fd].read_write_index,_open_file_table[fd].read_write_index+size,
+                &inode
+                );
 
-int _find_take_free_databloc()
-{
-    databloc_bitmap_t dbmap;
-    _loadDBMap((char*)&dbmap.map);
-    int i = _findfreeFromMap((char*)&dbmap.map);
-    if(i == -1)
+            if(ret == -1)
+            {
+                perror("File Read");
+                return -1;
+            }
+            //la position n avance que des octets reellement lus
+            _open_file_table[fd].read_write_index = _open_file_table[fd].read_write_index+ret;
+            _readahead(&_open_file_table[fd], &inode, _open_file_table[fd].read_write_index - ret, ret);
+            return ret;
+    }
+    else
     {
-        perror("Error to find free bloc");
+        perror("File Read");
         return -1;
     }
-    _setpos((char*)&dbmap.map, i, 1);
-    _writeDBMap((char*)&dbmap.map);
-    return i;
+
 }
 
-int _find_take_free_inode()
+/*
+ * Nouvelle taille du fichier: les blocs au dela sont rendus a la carte en une
+ * seule ecriture, la fin du dernier bloc garde est remise a 0; agrandir laisse un trou
+ */
+int File_Truncate(int fd, int size)
 {
-    inode_bitmap_t inmap;
-    _loadInodeMap((char*)&inmap.map);
-    int i = _findfreeFromMap((char*)&inmap.map);
-    if(i == -1)
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
     {
-        perror("Error to find free bloc");
+        osErrno = E_BAD_FD;
         return -1;
     }
-    _setpos((char*)&inmap.map, i, 1);
-    _writeInodeMap((char*)&inmap.map);
-    return i;
-}
-
-
-int _create_new_directory_entry(int index, const char* newEntryName, int entryType)
-{
-    inode_bloc_t inode; // une buffer de travail
-    inode_bloc_t inode_orig; // une copie propre
-
-    if( _getinodeByNumber(index, &inode) != 0)
+    if(size < 0 || size > MAX_FILE_SIZE)
     {
+        osErrno = E_FILE_TOO_BIG;
         return -1;
-    };
-
-    if( _getinodeByNumber(index, &inode_orig) != 0)
+    }
+    descriptor_entry_t* desc = &_open_file_table[fd];
+    if(_flush_write_buffer(desc) == -1 || _meta_begin() == -1)
     {
         return -1;
-    };
-
-    int taille = inode.size;
-    int nbBloc = 0;
-    if(taille != 0)
+    }
+    inode_bloc_t inode;
+    if(_getinodeByNumber(desc->inode_index, &inode) == -1)
     {
-    nbBloc  = (taille/sizeof(data_bloc_t))+1;//nbre de bloc deja utilise
+        _meta_abort();
+        return -1;
     }
-    else {
-    //sinon c est une initialisation nbBloc = 0, ici pour confirmation
-    nbBloc = 0;
+    //les bits des blocs liberes changent dans la transaction: la carte n est ecrite qu au commit
+    int keep = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    //un bloc vu directement par une fenetre de File_Map ne peut pas etre libere
+    if(_map_pins(desc->inode_index, keep))
+    {
+        _meta_abort();
+        osErrno = E_FILE_IN_USE;
+        return -1;
     }
-    //Verifier si nous avons besoin d un nouveau bloc de donnee
-    if(taille + sizeof(directory_entry_t) > nbBloc*sizeof(data_bloc_t))
+    for(int b = keep; b < DATA_BLOCK_PER_INODE; b++)
     {
-        //beson d un nouveau pointeur vers un bloc donnee
-        if( nbBloc < 30) // je verifie que je n utilise pas plus de 30 ptrs
+        if(inode.pointers[b] != -1)
         {
-        //ici je dois allouer un nouveau bloc donnee pour le repertoire
-        int indexDB = _find_take_free_databloc();
-        if(indexDB == -1)
+            _free_databloc(inode.pointers[b]);
+            inode.pointers[b] = -1;
+        }
+    }
+    //un agrandissement futur doit relire des 0 apres la nouvelle fin
+    if(size < inode.size && size % SECTOR_SIZE != 0 && inode.pointers[keep-1] != -1)
+    {
+        if(_unshare_bloc(&inode, keep-1) == -1)
         {
-            perror("No free databloc");
+            _meta_abort();
             return -1;
         }
-        inode.pointers[nbBloc] = indexDB;
-
-        }
-        else
+        char* data = Cache_Get(DB_OFFSET + inode.pointers[keep-1], 1);
+        if(data == NULL)
         {
-            perror("Max size for a directory is reached");
+            _meta_abort();
+            osErrno = E_GENERAL;
             return -1;
         }
+        memset(data + size % SECTOR_SIZE, 0, SECTOR_SIZE - size % SECTOR_SIZE);
+        Cache_Release(data, 1);
     }
-    //j augmente la taille avec la nouvelle entree
-    inode.size = inode.size + sizeof(directory_entry_t);
-    //lecture des entrees du repertoire
-    char* dirContent = alloca(inode.size);
-
-    _copy_file_content(dirContent,&inode);
-    //verification que la cle n existe pas
-
-    //verifier que le nom n existe pas deja
-    if ( _exists_key(dirContent, newEntryName, inode.size) )
+    inode.size = size;
+    if(_setinodeByNumber(desc->inode_index, &inode) || _meta_commit() == -1)
     {
-        perror("Key already exists ");
+        _meta_abort();
         return -1;
     }
+    desc->ra_window = 0;
+    desc->ra_next = 0;
+    return 0;
+}
 
-
-    //maintenant je me place a l ancien index pour ecrire la nouvelle entree
-    char* writeIndex = dirContent+inode_orig.size; // attention je regarde ma copie propre
-    directory_entry_t* writeIndexDir = (directory_entry_t*) writeIndex;
-    int newdirindex = -1;
-
-    if(entryType == DIRECTORY_TYPE)
+/*
+ * Reservation des blocs de [offset, offset+len): les trous recoivent des blocs
+ * consecutifs quand la carte le permet, remis a 0; la taille passe a offset+len
+ * si elle etait plus petite. Les ecritures suivantes n allouent plus rien
+ */
+int File_Allocate(int fd, int offset, int len)
+{
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
     {
-        newdirindex = _create_new_directory_inode();
+        osErrno = E_BAD_FD;
+        return -1;
     }
-    else
+    if(offset < 0 || len < 0 || offset + len > MAX_FILE_SIZE)
     {
-        newdirindex = _create_new_file_inode();
+        osErrno = E_FILE_TOO_BIG;
+        return -1;
     }
-    if(newdirindex == -1)
+    if(len == 0)
     {
-        perror("error on _create_new_directory_inode");
-        return -1;
+        return 0;
     }
-    writeIndexDir->index = newdirindex;
-
-    strcpy( writeIndexDir->name, newEntryName);
-    if( _write_file_content(dirContent,inode.size,&inode) == -1)
+    descriptor_entry_t* desc = &_open_file_table[fd];
+    if(_flush_write_buffer(desc) == -1 || _meta_begin() == -1)
     {
-        perror("Error on write content of directory");
         return -1;
     }
-
-    //le contenu du repertoire est copie maintenant je mets a jour l inode du repertoire
-    _setinodeByNumber(index,&inode);
-    return 0;
-};
-
-int _create_new_inode(int type)
-{
-    int index = _find_take_free_inode();
-    if(index == -1)
+    inode_bloc_t inode;
+    if(_getinodeByNumber(desc->inode_index, &inode) == -1)
     {
-        perror("Cannot find a new inode to create the directory");
+        _meta_abort();
         return -1;
     }
-    //load the inode table and set is to the correct values
-    int ind = index / 4; //num de secteur
-    int p = index % 4;
-    Sector sect_inout;
-    if  (Disk_Read(INODE_OFFSET+ind, (char *) &sect_inout.data)  == -1 ) {
-    perror("Disk_Read() failed\n");
-    osErrno = E_GENERAL;
-    return -1;
+    int first = offset / SECTOR_SIZE;
+    int last = (offset + len - 1) / SECTOR_SIZE;
+    int missing = 0;
+    for(int b = first; b <= last; b++)
+    {
+        missing += inode.pointers[b] == -1;
     }
-    inode_bloc_t inode_local;
-    inode_local.type = type;
-    inode_local.size = 0;
-    memset(inode_local.pointers,-1,30*sizeof(int));
-
-    memcpy(((inode_bloc_t *) &sect_inout.data)+p,&inode_local,sizeof(inode_bloc_t));
-
-    if  (Disk_Write(INODE_OFFSET+ind, (char *) &sect_inout.data)  == -1 ) {
-    perror("Disk_Write() failed\n");
-    osErrno = E_GENERAL;
-    return -1;
+    //une suite de blocs libres pour tous les trous, sinon bloc par bloc
+    int run = _find_take_free_run(missing);
+    for(int b = first; b <= last; b++)
+    {
+        if(inode.pointers[b] != -1)
+        {
+            continue;
+        }
+        int db = run != -1 ? run++ : _find_take_free_databloc();
+        if(db == -1)
+        {
+            _meta_abort();
+            osErrno = E_NO_SPACE;
+            return -1;
+        }
+        char* data = Cache_Get(DB_OFFSET + db, 0);
+        if(data == NULL)
+        {
+            _meta_abort();
+            osErrno = E_GENERAL;
+            return -1;
+        }
+        memset(data, 0, SECTOR_SIZE);
+        Cache_Release(data, 1);
+        inode.pointers[b] = db;
     }
-    return index;
-};
-
-//demande d une inode libre
-int _create_new_directory_inode()
-{
-    return _create_new_inode(DIRECTORY_TYPE);
-};
-int _create_new_file_inode()
-{
-    return _create_new_inode(FILE_TYPE);
-};
-
-//--//
-int _path_2_inode(const char* path, inode_bloc_t* ptr, int* retIndex)
-{
-    int  index =_path_2_inode_number(path);
-    if(index == -1) {return -1;}
-    if(retIndex != NULL) {*retIndex = index;}
-
-    return _getinodeByNumber(index, ptr);
+    inode.size = _max(inode.size, offset + len);
+    if(_setinodeByNumber(desc->inode_index, &inode) || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    return 0;
 }
 
-int _find_take_free_descriptor()
+/*
+ * Copie de len octets de src a srcOffset vers dst a dstOffset, dans une
+ * transaction ouverte. Un bloc entier de dst qui commence sur un bloc de src
+ * devient une reference de plus sur ce bloc; c est aussi le cas du dernier bloc
+ * de src quand la copie finit a la fin de src et depasse la fin de dst. Le reste
+ * passe des secteurs du cache de src a ceux de dst, sans autre copie.
+ * src et dst peuvent etre le meme inode si les plages ne se chevauchent pas
+ */
+int _copy_range(const inode_bloc_t* src, int srcOffset, inode_bloc_t* dst, int dstOffset, int len)
 {
-    int i = 0;
-        for (i = 0 ; i < MAX_OPEN_FILES; i++)
+    int done = 0;
+    while(done < len)
+    {
+        int s = srcOffset + done;
+        int d = dstOffset + done;
+        int rest = len - done;
+        if(s % SECTOR_SIZE == 0 && d % SECTOR_SIZE == 0
+           && (rest >= SECTOR_SIZE || (s + rest == src->size && d + rest >= dst->size)))
         {
-            if(!_open_file_table[i].used)
+            int b = d / SECTOR_SIZE;
+            int shared = _share_bloc(src->pointers[s / SECTOR_SIZE]);
+            if(shared == -2)
             {
-                _open_file_table[i].used = 1;
-                return i;
+                return -1;
+            }
+            if(dst->pointers[b] != -1)
+            {
+                _free_databloc(dst->pointers[b]);
             }
+            dst->pointers[b] = shared;
+            done += _min(SECTOR_SIZE, rest);
+            dst->size = _max(dst->size, dstOffset + done);
+            continue;
+        }
+        int chunk = _min(rest, _min(SECTOR_SIZE - s % SECTOR_SIZE, SECTOR_SIZE - d % SECTOR_SIZE));
+        int db = src->pointers[s / SECTOR_SIZE];
+        char* data = db == -1 ? (char*) _zero_bloc : Cache_Get(DB_OFFSET + db, 1);
+        if(data == NULL)
+        {
+            osErrno = E_GENERAL;
+            return -1;
+        }
+        file_iovec_t iov = { data + s % SECTOR_SIZE, chunk };
+        int wret = _write_file_vec(&iov, 1, d, dst);
+        if(db != -1)
+        {
+            Cache_Release(data, 0);
         }
-    return -1 ;
+        if(wret == -1)
+        {
+            return -1;
+        }
+        done += chunk;
+    }
+    return done;
 }
 
-
-
-//**************88
-/* Section des fonctions principales
+/*
+ * Le contenu du fichier dst est remplace par celui de src, sans copie: les
+ * blocs sont partages et ne seront copies qu a la premiere ecriture de l un
+ * des deux fichiers. Les positions des descripteurs ne changent pas
  */
-//**************88
-
-//sync du disque
-int
-FS_Sync()
+int File_Clone(int src, int dst)
 {
-    //FS_Syn
-    if( Disk_Save(fileName) == -1)
+    for(int i = 0; i < 2; i++)
     {
-        perror("FS_Sync()");
+        int fd = i == 0 ? src : dst;
+        if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
+        {
+            osErrno = E_BAD_FD;
+            return -1;
+        }
+    }
+    int srcIndex = _open_file_table[src].inode_index;
+    int dstIndex = _open_file_table[dst].inode_index;
+    if(srcIndex == dstIndex)
+    {
+        return 0;
+    }
+    //une fenetre directe ecrirait dans un bloc partage
+    if(_map_pins(srcIndex, 0) || _map_pins(dstIndex, 0))
+    {
+        osErrno = E_FILE_IN_USE;
         return -1;
-    };
+    }
+    if(_flush_write_buffer(&_open_file_table[src]) == -1 || _flush_write_buffer(&_open_file_table[dst]) == -1 || _meta_begin() == -1)
+    {
+        return -1;
+    }
+    inode_bloc_t srcInode;
+    inode_bloc_t dstInode;
+    if(_getinodeByNumber(srcIndex, &srcInode) == -1 || _getinodeByNumber(dstIndex, &dstInode) == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    for(int b = 0; b < DATA_BLOCK_PER_INODE; b++)
+    {
+        if(dstInode.pointers[b] != -1)
+        {
+            _free_databloc(dstInode.pointers[b]);
+            dstInode.pointers[b] = -1;
+        }
+    }
+    dstInode.size = 0;
+    if(_copy_range(&srcInode, 0, &dstInode, 0, srcInode.size) == -1
+       || _setinodeByNumber(dstIndex, &dstInode) || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
     return 0;
 }
 
-
-
-//fonction de boot
-int
-FS_Boot(char *path)
+/*
+ * Copie de len octets de src a srcOffset vers dst a dstOffset sans passer par
+ * un tampon de l appelant; les blocs entiers alignes sont partages comme par
+ * File_Clone. La copie s arrete a la fin de src; les positions des
+ * descripteurs ne changent pas. Retourne le nombre d octets copies
+ */
+int File_CopyRange(int src, int srcOffset, int dst, int dstOffset, int len)
 {
-    printf("FS_Boot %s\n", path);
-    fileName = path;
-    if (Disk_Init() == -1) {
-    perror("Disk_Init() failed\n");
-    osErrno = E_GENERAL;
-    return -1;
+    for(int i = 0; i < 2; i++)
+    {
+        int fd = i == 0 ? src : dst;
+        if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
+        {
+            osErrno = E_BAD_FD;
+            return -1;
+        }
     }
-
-    //Chargement du fichier image
-    if ( Disk_Load(path) == -1)
+    if(srcOffset < 0 || dstOffset < 0 || len < 0)
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    int srcIndex = _open_file_table[src].inode_index;
+    int dstIndex = _open_file_table[dst].inode_index;
+    if(_map_pins(srcIndex, 0) || _map_pins(dstIndex, 0))
+    {
+        osErrno = E_FILE_IN_USE;
+        return -1;
+    }
+    if(_flush_write_buffer(&_open_file_table[src]) == -1 || _flush_write_buffer(&_open_file_table[dst]) == -1 || _meta_begin() == -1)
+    {
+        return -1;
+    }
+    inode_bloc_t srcInode;
+    inode_bloc_t dstInode;
+    if(_getinodeByNumber(srcIndex, &srcInode) == -1 || _getinodeByNumber(dstIndex, &dstInode) == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    len = _max(0, _min(len, srcInode.size - srcOffset));
+    if(dstOffset + len > MAX_FILE_SIZE)
+    {
+        _meta_abort();
+        osErrno = E_FILE_TOO_BIG;
+        return -1;
+    }
+    //dans un meme fichier, la source est l inode modifie et les plages sont disjointes
+    inode_bloc_t* srcPtr = &srcInode;
+    if(srcIndex == dstIndex)
     {
-        //Disk_Load() failed;
-        if(diskErrno == E_OPENING_FILE) // si le fichier n existe pas je dois le creer
+        if(srcOffset < dstOffset + len && dstOffset < srcOffset + len)
         {
-            if( _createAndFormatNewDisc() == -1 )
-            {
-                osErrno = E_GENERAL;
-                return -1;
-            };
+            _meta_abort();
+            osErrno = E_GENERAL;
+            return -1;
         }
-        else
-        {
+        srcPtr = &dstInode;
+    }
+    int ret = _copy_range(srcPtr, srcOffset, &dstInode, dstOffset, len);
+    if(ret == -1 || _setinodeByNumber(dstIndex, &dstInode) || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    return ret;
+}
+
+/*
+ * Lecture positionnelle: size octets a offset, bornes a la fin du fichier
+ * la position du descripteur et sa lecture anticipee ne changent pas
+ */
+int File_PRead(int fd, void *buffer, int size, int offset)
+{
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
+    {
+        osErrno = E_BAD_FD;
+        return -1;
+    }
+    if(size < 0 || offset < 0)
+    {
         osErrno = E_GENERAL;
         return -1;
-        }
     }
-    //disque est charge dans la memoire
-    //verification du magic number
-    superblock_t buffer;
-    Disk_Read(0, (char*) &buffer);
-    if(buffer.magicnumber == MAGICNUMBER)
+    //les octets en attente du descripteur doivent etre visibles
+    if(_flush_write_buffer(&_open_file_table[fd]) == -1)
     {
-        // Image disque OK
-        return 0;
+        return -1;
     }
-    else
+    inode_bloc_t inode;
+    if(_getinodeByNumber(_open_file_table[fd].inode_index, &inode) == -1)
     {
-        perror("Erreur dans l'image disque");
         return -1;
     }
-
+    return _read_file_content(buffer, offset, offset + size, &inode);
 }
 
-
-
-//fonction deleguee pour creation d un repertoire
-// directory ops
-int Dir_Create(char *path) //PP
+/*
+ * Ecriture positionnelle: size octets a offset, sans toucher a la position du descripteur
+ */
+int File_PWrite(int fd, void *buffer, int size, int offset)
 {
-    char* pathcopy = alloca(strlen(path)+1);
-    if ( _copy_trim_last_token(pathcopy,path) != 0)
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
     {
-        perror("Error on path creation");
+        osErrno = E_BAD_FD;
         return -1;
-    };
-
-    int index = _path_2_inode_number(pathcopy);
-    if(index == -1)
+    }
+    if(size < 0 || offset < 0)
     {
-        perror("cannot find directory\n");
-        osErrno = E_NO_SUCH_FILE;
+        osErrno = E_GENERAL;
         return -1;
     }
-
-
-    //ajout d une nouvelle entree de type repertoire dans cette inode
-    char newEntryName[MAX_NAME_SIZE];
-    _get_last_token(newEntryName,path);
-    _create_new_directory_entry(index,newEntryName, DIRECTORY_TYPE);
-    return 0;
+    if(offset + size > MAX_FILE_SIZE)
+    {
+        osErrno = E_FILE_TOO_BIG;
+        return -1;
+    }
+    //le tampon d ecriture part d abord pour garder l ordre des ecritures
+    if(_flush_write_buffer(&_open_file_table[fd]) == -1)
+    {
+        return -1;
+    }
+    return _write_at(_open_file_table[fd].inode_index, buffer, offset, size);
 }
 
-
-
-int
-Dir_Size(char *path)
+/*
+ * Lecture vers plusieurs morceaux a la position du descripteur
+ */
+int File_ReadV(int fd, file_iovec_t *iov, int iovcnt)
 {
-    int index = _path_2_inode_number(path);
-    if(index == -1)
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 || iovcnt < 0 )
     {
+        osErrno = E_BAD_FD;
         return -1;
     }
-    inode_bloc_t bloc;
-    if(_getinodeByNumber(index,&bloc) == -1)
+    descriptor_entry_t* desc = &_open_file_table[fd];
+    if(_flush_write_buffer(desc) == -1)
     {
         return -1;
-    };
-    if( bloc.type != DIRECTORY_TYPE)
+    }
+    inode_bloc_t inode;
+    if(_getinodeByNumber(desc->inode_index, &inode) == -1)
     {
         return -1;
-    };
-    return bloc.size;
+    }
+    int ret = _read_file_vec(iov, iovcnt, desc->read_write_index, &inode);
+    if(ret == -1)
+    {
+        return -1;
+    }
+    desc->read_write_index += ret;
+    _readahead(desc, &inode, desc->read_write_index - ret, ret);
+    return ret;
 }
 
-int Dir_Read(char *path, void *buffer, int size)
+/*
+ * Ecriture de plusieurs morceaux a la position du descripteur, comme un seul
+ * File_Write de leur concatenation mais sans la copie intermediaire
+ */
+int File_WriteV(int fd, file_iovec_t *iov, int iovcnt)
 {
-    //Dir_Read
-    int index = _path_2_inode_number(path);
-    if(index == -1)
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 || iovcnt < 0 )
     {
+        osErrno = E_BAD_FD;
         return -1;
     }
-    //get directory inode
-    inode_bloc_t inode;
-    if( _getinodeByNumber( index , &inode ) == -1)
+    descriptor_entry_t* desc = &_open_file_table[fd];
+    int size = _iov_total(iov, iovcnt, MAX_FILE_SIZE);
+    if(size == -1 || desc->read_write_index + size > MAX_FILE_SIZE)
     {
-    osErrno = E_NO_SUCH_FILE;
-    return -1;
+        osErrno = E_FILE_TOO_BIG;
+        return -1;
     }
-    if( inode.type != DIRECTORY_TYPE)
+    //le tampon d ecriture part d abord pour garder l ordre des ecritures
+    if(_flush_write_buffer(desc) == -1 || _meta_begin() == -1)
     {
-        osErrno = E_GENERAL;
         return -1;
     }
-    if(inode.size > size)
+    inode_bloc_t inode;
+    if(_getinodeByNumber(desc->inode_index, &inode) == -1)
     {
-        osErrno = E_BUFFER_TOO_SMALL;
+        _meta_abort();
         return -1;
     }
-    //lecture du contenu du repertoire pour cherche le nom
-    //allocation de la memoire pour recevoir localement tout le contenu
-    char* data = alloca(inode.size);
-    /*copier tout le contenu pour travailler localement*/
-    if( _copy_file_content(data,&inode) == -1) //
+    int wret = _write_file_vec(iov, iovcnt, desc->read_write_index, &inode);
+    if(wret == -1)
     {
-    osErrno = E_GENERAL;
-    return -1;
+        _meta_abort();
+        return -1;
     }
-    memcpy(buffer,data,inode.size);
-    return (inode.size/sizeof(directory_entry_t));
+    if(_setinodeByNumber(desc->inode_index, &inode) || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    desc->read_write_index += wret;
+    return wret;
 }
 
-
-
-
-int
-Dir_Unlink(char *path)
+/*
+ * Lecture sans copie: iov recoit au plus iovcnt morceaux qui pointent dans les
+ * secteurs du cache, un par bloc, pour les octets [offset, offset+len) bornes a
+ * la fin du fichier. Les secteurs restent dans le cache jusqu a File_ReleaseView
+ * et ne doivent pas etre modifies. La position du descripteur ne change pas
+ * retourne le nombre de morceaux remplis (0 a la fin du fichier)
+ */
+int File_ReadView(int fd, int offset, int len, file_view_t* iov, int iovcnt)
 {
-    int size = Dir_Size(path);
-    if(size != 0)
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
+    {
+        osErrno = E_BAD_FD;
+        return -1;
+    }
+    if(offset < 0 || len < 0 || iovcnt < 0)
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    if(_flush_write_buffer(&_open_file_table[fd]) == -1)
     {
-        osErrno = E_DIR_NOT_EMPTY;
         return -1;
     }
-    //Contenant ici
-    char* pathContenant = alloca(strlen(path));
-    char name[16];
     inode_bloc_t inode;
-    int indexContenant;
-
-    _copy_trim_last_token(pathContenant,path);
-    int sizeContenant = Dir_Size(pathContenant);
-    char* buffer = alloca(sizeContenant);
-    _path_2_inode(pathContenant,&inode,&indexContenant);
-
-    _get_last_token(name,path);
-
-    int num = Dir_Read(pathContenant,buffer,sizeContenant);
-    int i = 0;
-
-    for(i = 0; i < num; i++)
+    if(_getinodeByNumber(_open_file_table[fd].inode_index, &inode) == -1)
+    {
+        return -1;
+    }
+    int end = _min(offset + len, inode.size);
+    int n = 0;
+    for(int pos = offset; pos < end && n < iovcnt; n++)
     {
-        if(strcmp( ( ((directory_entry_t*) buffer)+i)->name, name ) == 0)
+        int b = pos / SECTOR_SIZE;
+        int from = pos - b * SECTOR_SIZE;
+        //un trou est vu dans un bloc de 0 partage, qui n est pas dans le cache
+        char* data = inode.pointers[b] == -1 ? (char*) _zero_bloc : Cache_Get(DB_OFFSET + inode.pointers[b], 1);
+        if(data == NULL)
         {
-        (((directory_entry_t*) buffer)+i)->name[0] = '\0';
-        //il faut liberer inode
-        _free_inode((((directory_entry_t*) buffer)+i)->index);
-        (((directory_entry_t*) buffer)+i)->index = -1;
-        break;
+            //trop de secteurs retenus: rien n est rendu
+            File_ReleaseView(iov, n);
+            osErrno = E_GENERAL;
+            return -1;
         }
+        iov[n].base = data + from;
+        iov[n].len = _min(SECTOR_SIZE - from, end - pos);
+        pos += iov[n].len;
     }
-    //ecriture du contenu du fichier maintenant
-    _write_file_content(buffer,inode.size,&inode);
-    //inode du repertoire n a pas change donc pas besoin de la reecrire, juste le contenu avec la meme taille
-    return 0;
+    return n;
 }
 
+//rend au cache les secteurs d un File_ReadView
+void File_ReleaseView(file_view_t* iov, int iovcnt)
+{
+    for(int i = 0; i < iovcnt; i++)
+    {
+        if(iov[i].base < _zero_bloc || iov[i].base >= _zero_bloc + SECTOR_SIZE)
+        {
+            Cache_Release((char*) iov[i].base, 0);
+        }
+    }
+}
 
-
-
-//done
-int
-File_Open(char *file)
+/*
+ * Fenetre sur les octets [offset, offset+len) du fichier, lisible et modifiable
+ * sans passer par l API. Quand la plage tient dans un seul bloc alloue et dans
+ * la taille du fichier, la fenetre est le secteur du cache lui-meme: les deux
+ * sens sont visibles tout de suite. Sinon c est une copie: les octets au dela
+ * de la fin du fichier y valent 0 (les modifier agrandit le fichier), les
+ * modifications n arrivent dans le fichier qu au File_MapSync ou au File_Unmap,
+ * et les ecritures faites par l API ensuite n y apparaissent pas
+ * retourne NULL en cas d erreur
+ */
+void* File_Map(int fd, int offset, int len)
 {
-    int inodeindex = _path_2_inode_number(file);
-    if ( inodeindex == -1)
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
     {
-        osErrno = E_NO_SUCH_FILE;
-        return -1;
+        osErrno = E_BAD_FD;
+        return NULL;
     }
-    if(!_is_open_filetable_init) _init_open_file_table();
-    int des = _find_take_free_descriptor() ;
-    if ( des == -1)
+    if(offset < 0 || len <= 0 || offset + len > MAX_FILE_SIZE)
+    {
+        osErrno = E_GENERAL;
+        return NULL;
+    }
+    int m = 0;
+    while(m < MAX_FILE_MAPS && _file_map_table[m].used)
+    {
+        m++;
+    }
+    if(m == MAX_FILE_MAPS)
     {
         osErrno = E_TOO_MANY_OPEN_FILES;
-        return -1;
+        return NULL;
     }
-    _open_file_table[des].read_write_index = 0;
-    _open_file_table[des].inode_index = inodeindex;
-    return des;
+    if(_flush_write_buffer(&_open_file_table[fd]) == -1)
+    {
+        return NULL;
+    }
+    inode_bloc_t inode;
+    if(_getinodeByNumber(_open_file_table[fd].inode_index, &inode) == -1)
+    {
+        return NULL;
+    }
+    file_map_t* map = &_file_map_table[m];
+    int b = offset / SECTOR_SIZE;
+    map->addr = NULL;
+    map->orig = NULL;
+    map->direct = 0;
+    //un bloc partage avec un autre fichier n est vu qu a travers une copie
+    if(offset + len <= inode.size && (offset + len - 1) / SECTOR_SIZE == b && inode.pointers[b] != -1 && _bloc_shares(inode.pointers[b]) == 0)
+    {
+        //si le cache n a plus de secteur libre on se rabat sur une copie
+        char* data = Cache_Get(DB_OFFSET + inode.pointers[b], 1);
+        if(data != NULL)
+        {
+            map->addr = data + offset - b * SECTOR_SIZE;
+            map->direct = 1;
+        }
+    }
+    if(map->addr == NULL)
+    {
+        //la copie de reference suit la fenetre dans la meme allocation
+        map->addr = calloc(2 * len, 1);
+        if(map->addr == NULL)
+        {
+            osErrno = E_GENERAL;
+            return NULL;
+        }
+        if(_read_file_content(map->addr, offset, offset + len, &inode) == -1)
+        {
+            free(map->addr);
+            return NULL;
+        }
+        map->orig = map->addr + len;
+        memcpy(map->orig, map->addr, len);
+    }
+    map->used = 1;
+    map->fd = fd;
+    map->offset = offset;
+    map->len = len;
+    return map->addr;
 }
 
+//1 si une fenetre directe retient un bloc du fichier a partir du bloc fromBloc
+int _map_pins(int inodeIndex, int fromBloc)
+{
+    for(int m = 0; m < MAX_FILE_MAPS; m++)
+    {
+        file_map_t* map = &_file_map_table[m];
+        if(map->used && map->direct && _open_file_table[map->fd].inode_index == inodeIndex && map->offset / SECTOR_SIZE >= fromBloc)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
 
+//index de la fenetre d adresse addr, -1 si elle n existe pas
+int _map_find(void* addr)
+{
+    for(int m = 0; m < MAX_FILE_MAPS; m++)
+    {
+        if(_file_map_table[m].used && _file_map_table[m].addr == addr)
+        {
+            return m;
+        }
+    }
+    osErrno = E_GENERAL;
+    return -1;
+}
 
-
-
-//
-int
-File_Create(char *file)
+/*
+ * Une fenetre directe est marquee modifiee dans le cache. Pour une copie, seuls
+ * les octets changes depuis le File_Map ou le dernier File_MapSync sont ecrits,
+ * par suites contigues et dans une seule transaction: une ecriture faite par
+ * l API entre temps sur les autres octets est conservee
+ */
+int _map_sync(file_map_t* map)
 {
-    char filename[16];
-    char* containingPath = alloca(strlen(file)+1);
-    //avoir le chemin contenant et le nom du fichier a creer
-    if(
-    _get_containing_path_and_lastname(containingPath, filename, file)!= 0
-    )
+    if(map->direct)
+    {
+        Cache_MarkDirty(map->addr);
+        return 0;
+    }
+    if(memcmp(map->addr, map->orig, map->len) == 0)
+    {
+        return 0;
+    }
+    descriptor_entry_t* desc = &_open_file_table[map->fd];
+    if(_flush_write_buffer(desc) == -1 || _meta_begin() == -1)
     {
         return -1;
     }
-    //avoir l inode du repertoire contenant
-    int inodeContainingDir = -1;
     inode_bloc_t inode;
-
-    if(
-    _path_2_inode(containingPath,&inode, &inodeContainingDir)!= 0
-    )
+    if(_getinodeByNumber(desc->inode_index, &inode) == -1)
     {
+        _meta_abort();
         return -1;
     }
-
-
-    //ajout une nouvelle entree dans le contenu du repeortoire contenant
-    if (_create_new_directory_entry(inodeContainingDir,filename, FILE_TYPE))
+    int i = 0;
+    while(i < map->len)
     {
-        perror("Cannot create a new file");
+        if(map->addr[i] == map->orig[i])
+        {
+            i++;
+            continue;
+        }
+        int j = i + 1;
+        while(j < map->len && map->addr[j] != map->orig[j])
+        {
+            j++;
+        }
+        //au dela de la fin du fichier l ecriture l agrandit
+        if(_write_file_content(map->addr + i, map->offset + i, j - i, &inode) == -1)
+        {
+            _meta_abort();
+            return -1;
+        }
+        i = j;
+    }
+    if(_setinodeByNumber(desc->inode_index, &inode) || _meta_commit() == -1)
+    {
+        _meta_abort();
         return -1;
     }
+    memcpy(map->orig, map->addr, map->len);
     return 0;
 }
 
-//read
-int
-File_Read(int fd, void *buffer, int size)
+//ecriture dans le fichier des modifications de la fenetre rendue par File_Map
+int File_MapSync(void* addr)
 {
-    // verifier que fd pointe sur une inode ouverte
-    if( fd >= 0 && fd < MAX_OPEN_FILES && _open_file_table[fd].used && _open_file_table[fd].inode_index != -1  )
+    int m = _map_find(addr);
+    if(m == -1)
     {
-            //lecture du contenu du fichier a partir du numero d inode
-            inode_bloc_t inode;
-            if(_getinodeByNumber(_open_file_table[fd].inode_index, &inode) == -1)
-            {
-                return -1;
-            }
-            int ret = _read_file_content(
-                buffer,
-                _open_file_table[fd].read_write_index,_open_file_table[fd].read_write_index+size,
-                &inode
-                );
+        return -1;
+    }
+    return _map_sync(&_file_map_table[m]);
+}
 
-            if(ret == -1)
-            {
-                perror("File Read");
-                return -1;
-            }
-            _open_file_table[fd].read_write_index = _open_file_table[fd].read_write_index+size;
-            return ret;
+/*
+ * Ecriture des modifications puis fin de la fenetre; si l ecriture echoue la
+ * fenetre reste en place
+ */
+int File_Unmap(void* addr)
+{
+    int m = _map_find(addr);
+    if(m == -1)
+    {
+        return -1;
     }
-    else
+    file_map_t* map = &_file_map_table[m];
+    if(_map_sync(map) == -1)
     {
-        perror("File Read");
         return -1;
     }
+    if(map->direct)
+    {
+        Cache_Release(map->addr, 0);
+    }
+    else
+    {
+        free(map->addr);
+    }
+    map->used = 0;
+    return 0;
+}
 
+/*
+ * Apres une lecture de size octets a offset: si elle suit la precedente, la
+ * fenetre double (jusqu a READAHEAD_MAX_BLOCKS) et les blocs qui suivent sont
+ * demandes au cache; sinon la fenetre est fermee
+ */
+void _readahead(descriptor_entry_t* desc, const inode_bloc_t* inode_ptr, int offset, int size)
+{
+    if(size <= 0)
+    {
+        return;
+    }
+    if(offset == desc->next_sequential)
+    {
+        desc->ra_window = _min(_max(desc->ra_window * 2, READAHEAD_MIN_BLOCKS), READAHEAD_MAX_BLOCKS);
+    }
+    else
+    {
+        desc->ra_window = 0;
+        desc->ra_next = 0;
+    }
+    desc->next_sequential = offset + size;
+    if(desc->ra_window == 0)
+    {
+        return;
+    }
+    //blocs de la fenetre apres le dernier bloc lu, sans relancer ceux deja demandes
+    int lastBloc = (inode_ptr->size - 1) / SECTOR_SIZE;
+    int from = _max((offset + size) / SECTOR_SIZE, desc->ra_next);
+    int to = _min((offset + size - 1) / SECTOR_SIZE + desc->ra_window, lastBloc);
+    for(int b = from; b <= to; b++)
+    {
+        if(inode_ptr->pointers[b] != -1)
+        {
+            Cache_Prefetch(DB_OFFSET + inode_ptr->pointers[b]);
+        }
+    }
+    desc->ra_next = _max(desc->ra_next, to + 1);
 }
 
 int _max(int i, int j)
@@ -1086,45 +4155,67 @@ int _max(int i, int j)
     return (i<j)? j : i;
 }
 
+int _min(int i, int j)
+{
+    return (i<j)? i : j;
+}
+
 int
 File_Write(int fd, void *buffer, int size)
 {
 
-    if( fd >= 0 && fd < MAX_OPEN_FILES && _open_file_table[fd].used && _open_file_table[fd].inode_index != -1  )
+    if( fd >= 0 && fd < _open_file_capacity && _open_file_table[fd].used && _open_file_table[fd].inode_index != -1  )
     {
-        inode_bloc_t inode;
-        if(_getinodeByNumber(_open_file_table[fd].inode_index, &inode) == -1)
+        descriptor_entry_t* desc = &_open_file_table[fd];
+        int offset = desc->read_write_index;
+        if(size < 0 || offset < 0)
         {
-                return -1;
+            osErrno = E_GENERAL;
+            return -1;
         }
-        //copie du contenu du fichier
-        int newSize = _max(_open_file_table[fd].read_write_index+size, inode.size) ;
-
-        char* oldContentBuffer = alloca(newSize);
-
-        int ret = _read_file_content(oldContentBuffer,0,inode.size,&inode); //lecture uniquement de inode.size
-
-        if(ret == -1)
+        if(offset + size > MAX_FILE_SIZE)
+        {
+            osErrno = E_FILE_TOO_BIG;
+            return -1;
+        }
+        if(desc->wbuf != NULL)
+        {
+            //le tampon couvre les blocs entiers a partir du bloc de son premier octet
+            if(desc->wbuf_len > 0 && offset != desc->wbuf_offset + desc->wbuf_len)
+            {
+                if(_flush_write_buffer(desc) == -1)
+                {
+                    return -1;
+                }
+            }
+            if(desc->wbuf_len == 0)
+            {
+                desc->wbuf_offset = offset;
+            }
+            int limit = (desc->wbuf_offset / SECTOR_SIZE) * SECTOR_SIZE + WRITE_BUFFER_SIZE;
+            if(offset + size <= limit)
+            {
+                memcpy(desc->wbuf + desc->wbuf_len, buffer, size);
+                desc->wbuf_len += size;
+                desc->read_write_index = offset + size;
+                if(offset + size == limit && _flush_write_buffer(desc) == -1)
+                {
+                    return -1;
+                }
+                return size;
+            }
+            //ecriture trop grande pour le tampon: ce qui attend part d abord
+            if(_flush_write_buffer(desc) == -1)
             {
-                perror("File Write");
                 return -1;
             }
-
-        memcpy(oldContentBuffer+_open_file_table[fd].read_write_index, buffer,size );
-
-        _open_file_table[fd].read_write_index = _open_file_table[fd].read_write_index + size;
-        int wret = 0;
-        wret = _write_file_content(oldContentBuffer,newSize,&inode);
-
-        if( wret == -1)
+        }
+        int wret = _write_at(desc->inode_index, buffer, offset, size);
+        if(wret == -1)
         {
             return -1;
-        };
-        //mise a jour de l inode
-        if(_setinodeByNumber(_open_file_table[fd].inode_index,&inode))
-        {
-                return -1;
-        };
+        }
+        desc->read_write_index = offset + wret;
         return wret;
     }
     else
@@ -1134,11 +4225,102 @@ File_Write(int fd, void *buffer, int size)
     }
 }
 
+/*
+ * Les blocs alloues et l inode sont ecrits ensemble a la fin
+ * retourne le nombre d octets ecrits
+ */
+int _write_at(int inodeIndex, const char* buffer, int offset, int size)
+{
+    inode_bloc_t inode;
+    if( _meta_begin() == -1)
+    {
+        return -1;
+    }
+    if(_getinodeByNumber(inodeIndex, &inode) == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    //seuls les blocs de [offset, offset+size) sont lus ou ecrits
+    int wret = _write_file_content(buffer, offset, size, &inode);
+    if( wret == -1)
+    {
+        _meta_abort();
+        return -1;
+    };
+    //mise a jour de l inode
+    if(_setinodeByNumber(inodeIndex,&inode) || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    };
+    return wret;
+}
+
+/*
+ * Les octets en attente sont ecrits en une fois; l allocation des blocs et
+ * la taille du fichier ne changent qu ici. En cas d erreur (E_NO_SPACE...)
+ * les octets restent dans le tampon
+ */
+int _flush_write_buffer(descriptor_entry_t* desc)
+{
+    if(desc->wbuf == NULL || desc->wbuf_len == 0)
+    {
+        return 0;
+    }
+    if(_write_at(desc->inode_index, desc->wbuf, desc->wbuf_offset, desc->wbuf_len) == -1)
+    {
+        return -1;
+    }
+    desc->wbuf_len = 0;
+    return 0;
+}
+
+/*
+ * Active (enable a 1) ou coupe le tampon d ecriture du descripteur
+ * avec le tampon, une ecriture n arrive dans le fichier qu au remplissage
+ * du tampon, au File_Seek, au File_Read, au File_Close ou au FS_Sync; les
+ * autres descripteurs du fichier ne la voient pas avant
+ */
+int File_SetWriteBuffer(int fd, int enable)
+{
+    if( fd < 0 || fd >= _open_file_capacity || !_open_file_table[fd].used || _open_file_table[fd].inode_index == -1 )
+    {
+        osErrno = E_BAD_FD;
+        return -1;
+    }
+    descriptor_entry_t* desc = &_open_file_table[fd];
+    if(enable && desc->wbuf == NULL)
+    {
+        desc->wbuf = malloc(WRITE_BUFFER_SIZE);
+        if(desc->wbuf == NULL)
+        {
+            osErrno = E_GENERAL;
+            return -1;
+        }
+        desc->wbuf_len = 0;
+    }
+    else if(!enable && desc->wbuf != NULL)
+    {
+        if(_flush_write_buffer(desc) == -1)
+        {
+            return -1;
+        }
+        free(desc->wbuf);
+        desc->wbuf = NULL;
+    }
+    return 0;
+}
+
 int
 File_Seek(int fd, int offset)
 {
-    if( fd >= 0 && fd < MAX_OPEN_FILES && _open_file_table[fd].used && _open_file_table[fd].inode_index != -1  )
+    if( fd >= 0 && fd < _open_file_capacity && _open_file_table[fd].used && _open_file_table[fd].inode_index != -1  )
     {
+        if(_flush_write_buffer(&_open_file_table[fd]) == -1)
+        {
+            return -1;
+        }
         _open_file_table[fd].read_write_index = offset;
         return 0;
     }
@@ -1151,11 +4333,23 @@ File_Seek(int fd, int offset)
 int
 File_Close(int fd)
 {
-   if( fd >= 0 && fd < MAX_OPEN_FILES && _open_file_table[fd].used && _open_file_table[fd].inode_index != -1  )
+   if( fd >= 0 && fd < _open_file_capacity && _open_file_table[fd].used && _open_file_table[fd].inode_index != -1  )
     {
+        //les fenetres du descripteur sont ecrites et rendues avec lui
+        for(int m = 0; m < MAX_FILE_MAPS; m++)
+        {
+            if(_file_map_table[m].used && _file_map_table[m].fd == fd && File_Unmap(_file_map_table[m].addr) == -1)
+            {
+                return -1;
+            }
+        }
+        //si les octets en attente ne peuvent pas etre ecrits le descripteur reste ouvert
+        if(File_SetWriteBuffer(fd, 0) == -1)
+        {
+            return -1;
+        }
         _open_file_table[fd].read_write_index = 0;
-        _open_file_table[fd].used = 0;
-        _open_file_table[fd].inode_index = -1;
+        _release_descriptor(fd);
         return 0;
      }
     else
@@ -1169,189 +4363,298 @@ File_Close(int fd)
 //** DEBUT DES FONCTIONS A FAIRE DU CHAPITRE 1 BIS
 //***
 
-//TODO
-//Verifier si key est presente dans le contenu du repertoire pointe par keychain
-// keychain: tableau de directory_entry_t de taille 'size' octets
-// key: le nom recherche
-int _exists_key(const char* keychain, const char* key, int size)
-{
-      size_t find = 0;
-      int i = 0;
-      while(!find && i<size){
-        if(strcmp(keychain[i], key)){
-          find = 1;
-        }
-      }
-
-    return find;
-}
-
-//TODO
-// librer l inode a partir de son index
+// librer l inode a partir de son index, avec ses blocs de donnees
 int _free_inode(int ide)
 {
-    printf("_free_inode: Not Implemented\n");
-    return 0;
+    inode_bloc_t inode;
+    if(_getinodeByNumber(ide, &inode) == -1)
+    {
+        return -1;
+    }
+    if(inode.type == ORDERED_DIRECTORY_TYPE && inode.pointers[0] != -1)
+    {
+        //les noeuds de l arbre ne sont pas dans les pointeurs de l inode
+        _btree_free(inode.pointers[0]);
+        inode.pointers[0] = -1;
+    }
+    for(int i = 0; i < DATA_BLOCK_PER_INODE; i++)
+    {
+        if(inode.pointers[i] != -1 && _free_databloc(inode.pointers[i]) == -1)
+        {
+            return -1;
+        }
+    }
+    inode_bitmap_t inmap;
+    if(_loadInodeMap((char*)&inmap.map) == -1)
+    {
+        return -1;
+    }
+    _setpos((char*)&inmap.map, ide, 0);
+    return _writeInodeMap((char*)&inmap.map);
 }
 
 
-//TODO
 // Effacer le fichier du repertoire
 int
-File_Unlink(char *file) //Source from github (https://github.com/m30m/os-fs/blob/master/LibFS.c)
+File_Unlink(char *file)
 {
-  printf("File_Unlink\n");
-
-  struct inode *parent;
-  struct inode *node;
-  int parent_inode_number = find_last_parent(path, &parent);
-  int inode_number = find_inode(path, &node);
-  if (parent_inode_number == -1 || inode_number == -1)
-  {
-      osErrno = E_NO_SUCH_FILE;
-      return -1;
-  }
-  if (inode_open_count[inode_number] > 0)
-  {
-      osErrno = E_FILE_IN_USE;
-      free(parent);
-      free(node);
-      return -1;
-  }
-
-  if (node->type == DIR_TYPE)
-  {
-      fprintf(stderr, "Use dir unlink for directories\n");
-      return -1;
-  }
-
-  char *tmp = malloc(SECTOR_SIZE);
-  struct file_record *tmp_file_record = malloc(sizeof(struct file_record));
-
-  int i;
-  for (i = 0; i < DATA_BLOCK_PER_INODE; i++)
-  {
-      if (node->data_blocks[i] != 0)
-      {
-          set_datablock_bitmap(node->data_blocks[i], 0);
-      }
-  }
+    char filename[MAX_NAME_SIZE];
+    char* containingPath = alloca(strlen(file)+1);
+    if( _get_containing_path_and_lastname(containingPath, filename, file) != 0)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    int inodeContainingDir = -1;
+    inode_bloc_t dir;
+    if( _path_2_inode(containingPath, &dir, &inodeContainingDir) != 0)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
 
-  set_inode_bitmap(inode_number, 0);
+    //recherche du fichier dans son seau
+    int index = _dir_lookup(&dir, filename);
+    if(index == -1)
+    {
+        osErrno = E_NO_SUCH_FILE;
+        return -1;
+    }
+    inode_bloc_t inode;
+    if( _getinodeByNumber(index, &inode) == -1)
+    {
+        return -1;
+    }
+    if(_is_directory(inode.type))
+    {
+        perror("Use Dir_Unlink for directories");
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    //un fichier ouvert a son inode en memoire: il ne peut pas etre libere
+    if(_incore_inodes[index] != NULL)
+    {
+        osErrno = E_FILE_IN_USE;
+        return -1;
+    }
 
-  char found_entry_to_remove = 0;
-  for (i = 0; i < DATA_BLOCK_PER_INODE && !found_entry_to_remove; i++)
-  {
-      if (parent->data_blocks[i] != 0)
-      {
-          Disk_Read(parent->data_blocks[i], tmp);
-          int j;
-          for (j = 0; j < SECTOR_SIZE / sizeof(struct file_record); j++)
-          {
-              memcpy(tmp_file_record, &tmp[j * sizeof(struct file_record)], sizeof(struct file_record));
-              if (tmp_file_record->inode_number == inode_number)
-              {
-                  tmp_file_record->inode_number = 0;
-                  memset(tmp_file_record->name, 0, sizeof(tmp_file_record->name));
-                  memcpy(&tmp[j * sizeof(struct file_record)], tmp_file_record, sizeof(struct file_record));
-                  Disk_Write(parent->data_blocks[i], tmp);
-                  char is_whole_block_empty = 1;
-                  int k;
-                  for (k = 0; k < SECTOR_SIZE / sizeof(struct file_record); k++)
-                  {
-                      memcpy(tmp_file_record, &tmp[k * sizeof(struct file_record)], sizeof(struct file_record));
-                      if (tmp_file_record->inode_number != 0)
-                      {
-                          is_whole_block_empty = 0;
-                          break;
-                      }
-                  }
-                  if (is_whole_block_empty)
-                      set_datablock_bitmap(parent->data_blocks[i], 0);
-                  found_entry_to_remove = 1;
-                  break;
-              }
-
-          }
-      }
-  }
-  free(node);
-  free(parent);
-  free(tmp);
-  free(tmp_file_record);
-  return 0;
+    //comme pour la creation, un echec au milieu ne laisse ni inode libere encore
+    //reference ni seau fusionne dont les blocs sont rendus
+    if( _meta_begin() == -1)
+    {
+        return -1;
+    }
+    if( _dir_remove_entry(&dir, filename) == -1 || _free_inode(index) == -1 ||
+        _setinodeByNumber(inodeContainingDir, &dir) == -1 || _meta_commit() == -1)
+    {
+        _meta_abort();
+        return -1;
+    }
+    Dentry_Insert(inodeContainingDir, filename, DENTRY_NEGATIVE);
+    Dentry_InvalidatePaths();
+    return 0;
 }
 
 
-/* TODO
+/*
  * Lecture du contenu d un fichier represente par inode_ptr a partir l octet start jusqu a end
  * le buffer doit contenir assez d espace pour recevoir les donnees
+ * retourne le nombre d octets lus
  */
 int _read_file_content(char* buffer, int start, int end, const inode_bloc_t* inode_ptr)
 {
-
+    file_iovec_t one = { buffer, end - start };
+    return _read_file_vec(&one, 1, start, inode_ptr);
 }
 
-
-//TODO
-// ecrire simplement le contenu sur le disque a partir de l inode
-int _write_file_content(char* buffer, int size, inode_bloc_t* inode_ptr, int offset) // Source from website ()
+//copie de n octets de src vers les morceaux de iov a partir de la position (*idx, *off)
+void _iov_scatter(const char* src, int n, const file_iovec_t* iov, int* idx, int* off)
 {
-  const uint8_t *buffer = buffer_;
-int bytes_written = 0;
-uint8_t *bounce = NULL;
+    while(n > 0)
+    {
+        int part = _min(n, iov[*idx].len - *off);
+        memcpy((char*) iov[*idx].base + *off, src, part);
+        src += part;
+        n -= part;
+        *off += part;
+        if(*off == iov[*idx].len)
+        {
+            (*idx)++;
+            *off = 0;
+        }
+    }
+}
 
-if (inode->deny_write_cnt)
- return 0;
+//copie de n octets des morceaux de iov, a partir de la position (*idx, *off), vers dest
+void _iov_gather(char* dest, int n, const file_iovec_t* iov, int* idx, int* off)
+{
+    while(n > 0)
+    {
+        int part = _min(n, iov[*idx].len - *off);
+        memcpy(dest, (const char*) iov[*idx].base + *off, part);
+        dest += part;
+        n -= part;
+        *off += part;
+        if(*off == iov[*idx].len)
+        {
+            (*idx)++;
+            *off = 0;
+        }
+    }
+}
 
-while (size > 0)
- {
-   /* Sector to write, starting byte offset within sector. */
-   block_sector_t sector_idx = byte_to_sector (inode, offset);
-   int sector_ofs = offset % DATA_BLOCK_PER_INODE;
+//somme des longueurs des morceaux, -1 si une longueur est negative ou si elle depasse max
+int _iov_total(const file_iovec_t* iov, int iovcnt, int max)
+{
+    int total = 0;
+    for(int i = 0; i < iovcnt; i++)
+    {
+        if(iov[i].len < 0 || iov[i].len > max - total)
+        {
+            return -1;
+        }
+        total += iov[i].len;
+    }
+    return total;
+}
 
-   /* Bytes left in inode, bytes left in sector, lesser of the two. */
-   int inode_left = inode_length (inode) - offset;
-   int sector_left = DATA_BLOCK_PER_INODE - sector_ofs;
-   int min_left = inode_left < sector_left ? inode_left : sector_left;
+/*
+ * Lecture a partir de l octet start dans les morceaux de iov, bornee a la fin du
+ * fichier; chaque bloc est copie une seule fois, du cache vers les morceaux
+ * retourne le nombre d octets lus
+ */
+int _read_file_vec(const file_iovec_t* iov, int iovcnt, int start, const inode_bloc_t* inode_ptr)
+{
+    if(start < 0)
+    {
+        osErrno = E_SEEK_OUT_OF_BOUNDS;
+        return -1;
+    }
+    //une demande plus grande que le fichier est bornee a sa fin, seule une
+    //longueur negative est une erreur
+    int total = _iov_total(iov, iovcnt, INT_MAX);
+    if(total == -1)
+    {
+        osErrno = E_GENERAL;
+        return -1;
+    }
+    int end = total > inode_ptr->size - start ? inode_ptr->size : start + total;
+    if(start >= end)
+    {
+        return 0;
+    }
+    int idx = 0;
+    int off = 0;
+    int done = 0;
+    int size = end - start;
+    for(int b = start / SECTOR_SIZE; done < size; b++)
+    {
+        int from = start + done - b * SECTOR_SIZE;
+        int chunk = _min(SECTOR_SIZE - from, size - done);
+        if(inode_ptr->pointers[b] == -1)
+        {
+            //trou: aucun bloc alloue, le contenu est nul
+            _iov_scatter(_zero_bloc + from, chunk, iov, &idx, &off);
+            done += chunk;
+            continue;
+        }
+        char* data = Cache_Get(DB_OFFSET + inode_ptr->pointers[b], 1);
+        if(data == NULL)
+        {
+            perror("Disk_Read() failed\n");
+            osErrno = E_GENERAL;
+            return -1;
+        }
+        _iov_scatter(data + from, chunk, iov, &idx, &off);
+        Cache_Release(data, 0);
+        done += chunk;
+    }
+    return done;
+}
 
-   /* Number of bytes to actually write into this sector. */
-   int chunk_size = size < min_left ? size : min_left;
-   if (chunk_size <= 0)
-     break;
 
-   if (sector_ofs == 0 && chunk_size == DATA_BLOCK_PER_INODE)
-     {
-       /* Write full sector directly to disk. */
-       block_write (fs_device, sector_idx, buffer + bytes_written);
-     }
-   else
-     {
-       /* We need a bounce buffer. */
-       if (bounce == NULL)
-         {
-           bounce = malloc (DATA_BLOCK_PER_INODE);
-           if (bounce == NULL)
-             break;
-         }
-
-       /* If the sector contains data before or after the chunk
-          we're writing, then we need to read in the sector
-          first.  Otherwise we start with a sector of all zeros. */
-       if (sector_ofs > 0 || chunk_size < sector_left)
-         block_read (fs_device, sector_idx, bounce);
-       else
-         memset (bounce, 0, DATA_BLOCK_PER_INODE);
-       memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-       block_write (fs_device, sector_idx, bounce);
-     }
+//ecriture de size octets de buffer a la position offset du fichier
+int _write_file_content(const char* buffer, int offset, int size, inode_bloc_t* inode_ptr)
+{
+    file_iovec_t one = { (void*) buffer, size };
+    return _write_file_vec(&one, 1, offset, inode_ptr);
+}
 
-   /* Advance. */
-   size -= chunk_size;
-   offset += chunk_size;
-   bytes_written += chunk_size;
- }
-free (bounce);
+/*
+ * Ecriture des morceaux de iov a la position offset du fichier
+ * seuls les blocs couverts par [offset, offset+size) sont touches: un bloc
+ * entierement couvert est ecrit sans etre lu, un bloc de bord deja present est
+ * lu puis reecrit, un bloc neuf est complete par des 0; les morceaux sont
+ * copies directement dans les secteurs du cache
+ * les blocs manquants de [offset, offset+size) sont alloues et la taille mise a jour
+ * retourne le nombre d octets ecrits
+ */
+int _write_file_vec(const file_iovec_t* iov, int iovcnt, int offset, inode_bloc_t* inode_ptr)
+{
+    int size = _iov_total(iov, iovcnt, MAX_FILE_SIZE);
+    if(size == -1 || offset < 0 || offset + size > MAX_FILE_SIZE)
+    {
+        osErrno = E_FILE_TOO_BIG;
+        return -1;
+    }
+    if(size == 0)
+    {
+        return 0;
+    }
+    int end = offset + size;
+    int first = offset / SECTOR_SIZE;
+    int last = (end - 1) / SECTOR_SIZE;
+
+    //allocation des seuls blocs touches: ceux d avant restent des trous qui se lisent comme des 0
+    //fresh[b] indique un bloc neuf, sans contenu a relire
+    char fresh[DATA_BLOCK_PER_INODE];
+    memset(fresh, 0, sizeof(fresh));
+    for(int b = first; b <= last; b++)
+    {
+        if(inode_ptr->pointers[b] != -1)
+        {
+            //un bloc partage avec un autre fichier est d abord copie
+            if(_unshare_bloc(inode_ptr, b) == -1)
+            {
+                return -1;
+            }
+            continue;
+        }
+        int db = _find_take_free_databloc();
+        if(db == -1)
+        {
+            osErrno = E_NO_SPACE;
+            return -1;
+        }
+        inode_ptr->pointers[b] = db;
+        fresh[b] = 1;
+    }
 
-return bytes_written;
+    int idx = 0;
+    int off = 0;
+    int done = 0;
+    for(int b = first; b <= last; b++)
+    {
+        int blocStart = b * SECTOR_SIZE;
+        int from = offset + done - blocStart;
+        int chunk = _min(SECTOR_SIZE - from, size - done);
+        //bloc entierement couvert ou neuf: pas de lecture
+        int full = chunk == SECTOR_SIZE;
+        char* data = Cache_Get(DB_OFFSET + inode_ptr->pointers[b], !full && !fresh[b]);
+        if(data == NULL)
+        {
+            perror("Disk_Write() failed\n");
+            osErrno = E_GENERAL;
+            return -1;
+        }
+        if(!full && fresh[b])
+        {
+            memset(data, 0, SECTOR_SIZE);
+        }
+        _iov_gather(data + from, chunk, iov, &idx, &off);
+        Cache_Release(data, 1);
+        done += chunk;
+    }
+    inode_ptr->size = _max(inode_ptr->size, end);
+    return done;
 }
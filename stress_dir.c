@@ -0,0 +1,251 @@
+/*
+ * Test de charge des repertoires indexes par hachage lineaire
+ *
+ *   gcc -o stress_dir stress_dir.c myFile.c Disque.c Dentry.c DirSearch.c Cache.c
+ *   ./stress_dir
+ *
+ * creations et suppressions au hasard autour des seuils d eclatement et de
+ * fusion des seaux; apres chaque serie, chaque nom vivant doit etre rendu par
+ * Dir_Read et retrouve par File_Open, puis pouvoir etre supprime a la fin. Le
+ * cache des dentries est vide avant ces recherches: il cacherait une entree
+ * perdue dans l index. Un second repertoire rejoue le cas d une chaine de
+ * debordement qui passe du dernier seau au seau 0 pendant que le repertoire
+ * retrecit puis regrandit
+ * retourne 0 si tout est retrouve
+ */
+#include "LibFS.h"
+#include "Dentry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IMAGE "/tmp/stress_dir.img"
+#define NAMES 800 // au dela de ce que 30 seaux rangent sans debordement
+#define ROUNDS 200
+#define OPS_PER_ROUND 80
+#define ENTRY_SIZE 20 // nom de 16 octets + numero d inode
+
+static int live[NAMES];
+
+//meme hachage que myFile.c (FNV-1a) et seau sur 30 seaux
+static int _home_30(const char* name)
+{
+    unsigned int hash = 2166136261u;
+    for(int i = 0; name[i] != '\0'; i++)
+    {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash % 32 < 30 ? hash % 32 : hash % 16;
+}
+
+//premier nom prefix<k> range dans le seau bucket, k a partir de *next
+static void _name_in(char* dest, const char* prefix, int bucket, int* next)
+{
+    do
+    {
+        sprintf(dest, "%s%d", prefix, (*next)++);
+    } while(_home_30(dest) != bucket);
+}
+
+/*
+ * Les seaux 28 et 29 sont remplis, x deborde de 28 jusqu au seau 0; tout le
+ * reste est supprime (le seau 29 est fusionne, le 28 garde x ailleurs et reste)
+ * puis le repertoire regrandit jusqu a 30 seaux: x doit rester trouvable
+ */
+static int _wrap_scenario()
+{
+    char path[32];
+    char x[16];
+    char name[16];
+    int next = 0;
+    if(Dir_Create("/w") == -1)
+    {
+        return -1;
+    }
+    //600 noms: le repertoire a ses 30 seaux
+    for(int i = 0; i < 600; i++)
+    {
+        sprintf(path, "/w/g%d", i);
+        if(File_Create(path) == -1)
+        {
+            return -1;
+        }
+    }
+    for(int b = 28; b <= 29; b++)
+    {
+        for(int i = 0; i < 25; i++)
+        {
+            _name_in(name, "h", b, &next);
+            sprintf(path, "/w/%s", name);
+            if(File_Create(path) == -1)
+            {
+                return -1;
+            }
+        }
+    }
+    _name_in(x, "x", 28, &next);
+    sprintf(path, "/w/%s", x);
+    if(File_Create(path) == -1)
+    {
+        return -1;
+    }
+    for(int i = 0; i < 600; i++)
+    {
+        sprintf(path, "/w/g%d", i);
+        if(File_Unlink(path) == -1)
+        {
+            return -1;
+        }
+    }
+    //les numeros sautes par _name_in n ont pas de fichier, l echec est attendu
+    for(int k = 0; k < next; k++)
+    {
+        sprintf(path, "/w/h%d", k);
+        File_Unlink(path);
+    }
+    for(int i = 0; i < 600; i++)
+    {
+        sprintf(path, "/w/r%d", i);
+        if(File_Create(path) == -1)
+        {
+            return -1;
+        }
+    }
+    Dentry_Reset();
+    sprintf(path, "/w/%s", x);
+    if(File_Unlink(path) == -1)
+    {
+        printf("%s introuvable apres que le repertoire a regrandi\n", path);
+        return -1;
+    }
+    for(int i = 0; i < 600; i++)
+    {
+        sprintf(path, "/w/r%d", i);
+        if(File_Unlink(path) == -1)
+        {
+            return -1;
+        }
+    }
+    return Dir_Unlink("/w");
+}
+
+static void _path(char* dest, int n)
+{
+    sprintf(dest, "/d/n%d", n);
+}
+
+//chaque nom vivant apparait une fois dans Dir_Read, et aucun autre
+static int _check_listing(int nbLive)
+{
+    static char buffer[30 * 25 * ENTRY_SIZE];
+    int size = Dir_Size("/d");
+    if(size != nbLive * ENTRY_SIZE)
+    {
+        printf("Dir_Size %d, %d entrees attendues\n", size, nbLive);
+        return -1;
+    }
+    int nb = Dir_Read("/d", buffer, sizeof(buffer));
+    if(nb != nbLive)
+    {
+        printf("Dir_Read %d entrees, %d attendues\n", nb, nbLive);
+        return -1;
+    }
+    char seen[NAMES];
+    memset(seen, 0, sizeof(seen));
+    for(int i = 0; i < nb; i++)
+    {
+        int n = atoi(buffer + i * ENTRY_SIZE + 1);
+        if(n < 0 || n >= NAMES || !live[n] || seen[n])
+        {
+            printf("entree inattendue %s\n", buffer + i * ENTRY_SIZE);
+            return -1;
+        }
+        seen[n] = 1;
+    }
+    //Dir_Read lit les seaux un par un, la recherche passe par le hachage du nom
+    Dentry_Reset();
+    char path[32];
+    for(int n = 0; n < NAMES; n++)
+    {
+        _path(path, n);
+        int fd = live[n] ? File_Open(path) : -1;
+        if(live[n] && (fd == -1 || File_Close(fd) == -1))
+        {
+            printf("%s listee mais introuvable\n", path);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    char path[32];
+    unlink(IMAGE);
+    if(FS_Boot(IMAGE) == -1 || Dir_Create("/d") == -1)
+    {
+        return 1;
+    }
+    srand(42);
+    int nbLive = 0;
+    for(int r = 0; r < ROUNDS; r++)
+    {
+        //la population oscille entre 0 et NAMES pour traverser tous les seuils
+        int target = (r / 20) % 2 == 0 ? NAMES * 7 / 8 : NAMES / 16;
+        for(int op = 0; op < OPS_PER_ROUND; op++)
+        {
+            int n = rand() % NAMES;
+            int create = nbLive < target ? rand() % 4 != 0 : rand() % 4 == 0;
+            _path(path, n);
+            if(create && !live[n])
+            {
+                if(File_Create(path) == -1)
+                {
+                    printf("File_Create %s: %d\n", path, osErrno);
+                    return 1;
+                }
+                live[n] = 1;
+                nbLive++;
+            }
+            else if(!create && live[n])
+            {
+                if(File_Unlink(path) == -1)
+                {
+                    printf("File_Unlink %s: %d (tour %d)\n", path, osErrno, r);
+                    return 1;
+                }
+                live[n] = 0;
+                nbLive--;
+            }
+        }
+        if(_check_listing(nbLive) == -1)
+        {
+            printf("tour %d\n", r);
+            return 1;
+        }
+    }
+    Dentry_Reset();
+    for(int n = 0; n < NAMES; n++)
+    {
+        _path(path, n);
+        if(live[n] && File_Unlink(path) == -1)
+        {
+            printf("File_Unlink %s: %d\n", path, osErrno);
+            return 1;
+        }
+    }
+    if(Dir_Size("/d") != 0 || Dir_Unlink("/d") == -1)
+    {
+        printf("repertoire pas vide a la fin\n");
+        return 1;
+    }
+    if(_wrap_scenario() == -1)
+    {
+        printf("debordement du dernier seau: %d\n", osErrno);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}